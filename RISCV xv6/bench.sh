@@ -0,0 +1,3 @@
+#!boogsh
+# Benchmark suite, as CSV. Runs every scenario of user/bench.c.
+bench -c
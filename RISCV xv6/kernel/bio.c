@@ -1,10 +1,16 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
+// Buffers are hashed by (dev, blockno) into NBUCKET buckets, each
+// with its own lock, so lookups of different blocks don't contend.
+// A miss recycles an unused buffer chosen by a clock sweep over
+// all buffers; bcache.lock serializes misses so that two processes
+// can't both install a buffer for the same block.
+//
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
@@ -22,34 +28,124 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstat.h"
+#include "rusage.h"
+#include "proc.h"
+
+struct bucket {
+  struct spinlock lock;  // protects the list and refcnt/used of its bufs
+  struct buf head;       // list of buffers hashing here, through prev/next
+  uint64 hits;
+  uint64 misses;
+};
 
 struct {
-  struct spinlock lock;
+  struct spinlock lock;  // serializes recycling; protects hand
   struct buf buf[NBUF];
+  struct bucket bucket[NBUCKET];
+  int hand;              // clock hand, index into buf[]
+  uint64 evictions;
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // read-ahead statistics, updated atomically.
+  uint64 ra_issued;      // blocks read by bprefetch()
+  uint64 ra_hits;        // prefetched blocks later found by bread()
+  uint64 ra_late;        // ...that were still on their way from disk
+  uint64 ra_wasted;      // prefetched blocks evicted without being read
+  uint64 sync_reads;     // blocks bread() had to wait for the disk to read
 } bcache;
 
+static struct bucket*
+bhash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
+// Add b to the front of bucket bk's list.
+// Caller must hold bk->lock.
+static void
+binsert(struct bucket *bk, struct buf *b)
+{
+  b->next = bk->head.next;
+  b->prev = &bk->head;
+  bk->head.next->prev = b;
+  bk->head.next = b;
+}
+
+// Find dev/blockno in bucket bk.
+// Caller must hold bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head.next; b != &bk->head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  }
+  return 0;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    initlock(&bk->lock, "bcache.bucket");
+    bk->head.prev = &bk->head;
+    bk->head.next = &bk->head;
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Spread the empty buffers over the buckets. Device 0
+  // is never read, so these never match a lookup.
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+    b->dev = 0;
+    b->blockno = b - bcache.buf;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    binsert(bhash(b->dev, b->blockno), b);
+  }
+}
+
+// Choose an unused buffer to recycle and unlink it from its bucket.
+// The clock hand gives buffers released since its last pass a
+// second chance, so two sweeps always find a victim if one exists.
+// Caller must hold bcache.lock, which keeps b->dev and b->blockno
+// (and so b's bucket) from changing underneath us.
+static struct buf*
+bvictim(void)
+{
+  struct buf *b;
+  struct bucket *bk;
+
+  for(int i = 0; i < 2*NBUF; i++){
+    b = &bcache.buf[bcache.hand];
+    bcache.hand = (bcache.hand + 1) % NBUF;
+    if(b->refcnt != 0 || b->disk)
+      continue;
+    bk = bhash(b->dev, b->blockno);
+    acquire(&bk->lock);
+    // b->disk can't become set while refcnt is 0; a prefetch
+    // that is still in flight keeps the buffer off limits.
+    if(b->refcnt == 0 && b->disk == 0){
+      if(b->used){
+        b->used = 0;
+      } else {
+        b->next->prev = b->prev;
+        b->prev->next = b->next;
+        release(&bk->lock);
+        bcache.evictions++;
+        if(b->prefetched){
+          b->prefetched = 0;
+          __sync_fetch_and_add(&bcache.ra_wasted, 1);
+        }
+        return b;
+      }
+    }
+    release(&bk->lock);
   }
+  panic("bget: no buffers");
 }
 
 // Look through buffer cache for block on device dev.
@@ -59,33 +155,50 @@ static struct buf*
 bget(uint dev, uint blockno)
 {
   struct buf *b;
-
-  acquire(&bcache.lock);
+  struct bucket *bk = bhash(dev, blockno);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    b->refcnt++;
+    bk->hits++;
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bk->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  // Not cached. Another process may have missed on the same
+  // block and installed it while we waited for bcache.lock,
+  // so look again before recycling a buffer.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    b->refcnt++;
+    bk->hits++;
+    release(&bk->lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
   }
-  panic("bget: no buffers");
+  bk->misses++;
+  release(&bk->lock);
+
+  b = bvictim();
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->prefetched = 0;
+  b->refcnt = 1;
+  b->used = 0;
+
+  acquire(&bk->lock);
+  binsert(bk, b);
+  release(&bk->lock);
+  release(&bcache.lock);
+
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -96,58 +209,153 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
+    __sync_fetch_and_add(&bcache.sync_reads, 1);
+    myproc()->ru.inblock++;
     virtio_disk_rw(b, 0);
     b->valid = 1;
+  } else if(b->prefetched) {
+    b->prefetched = 0;
+    __sync_fetch_and_add(&bcache.ra_hits, 1);
+    if(b->disk) {
+      // the read from bprefetch() is still in flight.
+      __sync_fetch_and_add(&bcache.ra_late, 1);
+      virtio_disk_wait(b);
+    }
   }
   return b;
 }
 
+// Start reading the n blocks in blocknos[] into the cache without
+// waiting for them, so that later bread()s find them in memory.
+// Blocks that are already cached are skipped; runs of consecutive
+// block numbers are merged into single disk requests.
+void
+bprefetch(uint dev, uint *blocknos, int n)
+{
+  struct buf *bs[NPREFETCH];
+  struct buf *b;
+  int i, nb = 0, run = 0;
+
+  if(n > NPREFETCH)
+    n = NPREFETCH;
+
+  for(i = 0; i < n; i++){
+    b = bget(dev, blocknos[i]);
+    if(b->valid){
+      brelse(b);
+      continue;
+    }
+    bs[nb++] = b;
+  }
+
+  // the data is valid as soon as the disk is done with it;
+  // bread() waits for b->disk to clear before returning b.
+  for(i = 0; i < nb; i++){
+    bs[i]->valid = 1;
+    bs[i]->prefetched = 1;
+    if(i+1 == nb || bs[i+1]->blockno != bs[i]->blockno + 1){
+      virtio_disk_submit(&bs[run], i + 1 - run, 0);
+      run = i + 1;
+    }
+  }
+  for(i = 0; i < nb; i++)
+    brelse(bs[i]);
+  __sync_fetch_and_add(&bcache.ra_issued, nb);
+  myproc()->ru.inblock += nb;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
+  myproc()->ru.oublock++;
   virtio_disk_rw(b, 1);
 }
 
+// Write the n locked bufs in bs[] to disk and wait for all of them.
+// The writes are issued together, and runs of consecutive
+// block numbers go to the disk as single requests.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i, run = 0;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+    myproc()->ru.oublock++;
+    if(i+1 == n || bs[i+1]->blockno != bs[i]->blockno + 1){
+      virtio_disk_submit(&bs[run], i + 1 - run, 1);
+      run = i + 1;
+    }
+  }
+  for(i = 0; i < n; i++)
+    virtio_disk_wait(bs[i]);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Mark it recently used so the clock hand passes it over once.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->used = 1;
   }
-  
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
+// Gather buffer cache statistics for kstat().
+void
+bcachestat(struct bcachestat *st)
+{
+  memset(st, 0, sizeof(*st));
+  st->nbuf = NBUF;
+  st->nbucket = NBUCKET;
+  for(struct bucket *bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    st->hits += bk->hits;
+    st->misses += bk->misses;
+  }
+  st->evictions = bcache.evictions;
+}
 
+// Gather read-ahead statistics for kstat().
+void
+rastat(struct rastat *st)
+{
+  st->issued = bcache.ra_issued;
+  st->hits = bcache.ra_hits;
+  st->late = bcache.ra_late;
+  st->wasted = bcache.ra_wasted;
+  st->misses = bcache.sync_reads;
+}
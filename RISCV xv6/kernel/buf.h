@@ -1,11 +1,14 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  struct buf *qnext; // next buf in the same disk request
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  int used;    // released since the eviction clock hand last passed?
+  int prefetched; // read ahead by bprefetch(), not yet bread()?
+  struct buf *prev; // hash bucket list
   struct buf *next;
   uchar data[BSIZE];
 };
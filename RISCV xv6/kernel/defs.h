@@ -2,6 +2,13 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmemstat;
+struct bcachestat;
+struct diskstat;
+struct rastat;
+struct logstat;
+struct vmstat;
+struct schedstat;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -14,8 +21,12 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+void            bprefetch(uint, uint*, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bcachestat(struct bcachestat*);
+void            rastat(struct rastat*);
 
 // console.c
 void            consoleinit(void);
@@ -24,6 +35,9 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+void            execinit(void);
+int             execfault(struct proc*, uint64, int);
+void            execinval(struct inode*);
 
 // file.c
 struct file*    filealloc(void);
@@ -64,10 +78,14 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kmemstat(struct kmemstat*);
+void            krefget(void *);
+int             krefcnt(void *);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            logstat(struct logstat*);
 void            begin_op(void);
 void            end_op(void);
 
@@ -103,8 +121,10 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64 addr);
 int             wait2(uint64 addr, uint64 res); // replaced wait (lab05)
+int             wait3(uint64 addr, uint64 res, int options, uint64 ru);
 void            wakeup(void*);
 void            yield(void);
+void            schedstat(struct schedstat*);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
@@ -119,6 +139,7 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             lockstat(uint64, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -135,12 +156,33 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// prof.c
+void            profinit(void);
+void            profrecord(uint64, int);
+int             prof(int, uint64, int);
+
+// vdso.c
+void            vdsoinit(void);
+int             vdsomap(pagetable_t);
+uint64          monotime(void);
+
+// trace.c
+struct tracerec;
+int             tracestart(struct proc*);
+void            tracefree(struct proc*);
+void            tracebegin(struct proc*, int, struct tracerec*);
+void            traceend(struct proc*, struct tracerec*, uint64);
+int             tracedrain(int, uint64, int);
+
 // syscall.c
 void            argint(int, int*);
 int             argstr(int, char*, int);
 void            argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
+void            sysstatclear(struct proc*);
+void            sysstatreap(struct proc*, struct proc*);
+int             sysstatget(int, uint64);
 void            syscall();
 
 // trap.c
@@ -167,6 +209,12 @@ void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmlazy(pagetable_t, uint64, uint64);
+int             uvmfault(struct proc*, uint64, int);
+void            uvmprefault(pagetable_t, uint64, uint64);
+void            lazyreserve(uint64);
+void            vmstat(struct vmstat*);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
@@ -185,6 +233,9 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_submit(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
+void            virtio_disk_stat(struct diskstat *);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -3,9 +3,45 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "kstat.h"
+#include "vdso.h"
+
+// Read-only segments of an executable are not loaded by exec().
+// Their pages are mapped by execfault() when the program first
+// touches them, from a cache of pages shared by every process
+// running the same executable. The cache holds one reference to
+// each page and every mapping another, so a page evicted from
+// the cache stays valid until its last mapping goes away.
+// Writing to or truncating the file drops its cached pages.
+
+struct execpage {
+  uint dev;
+  uint inum;     // 0 if the slot is unused
+  uint off;
+  uint n;        // bytes read from the file, rest are zero
+  char *pa;
+};
+
+struct {
+  struct spinlock lock;
+  struct execpage pg[NEXECPAGE];
+  int hand;      // next slot to evict
+} pcache;
+
+extern struct vmstat vmstats;
+
+void
+execinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
 
 static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
 
@@ -19,6 +55,144 @@ int flags2perm(int flags)
     return perm;
 }
 
+// Find the page of ip at off holding n bytes of the file, if cached.
+// Caller must hold pcache.lock.
+static struct execpage*
+execlookup(struct inode *ip, uint off, uint n)
+{
+  for(struct execpage *e = pcache.pg; e < pcache.pg+NEXECPAGE; e++)
+    if(e->inum == ip->inum && e->dev == ip->dev && e->off == off && e->n == n)
+      return e;
+  return 0;
+}
+
+// Return a page holding n bytes of ip starting at off followed
+// by zeros, with a reference for the caller, or 0 on failure.
+static char*
+execpage(struct inode *ip, uint off, uint n)
+{
+  struct execpage *e;
+  char *mem, *old = 0;
+
+  acquire(&pcache.lock);
+  if((e = execlookup(ip, off, n)) != 0){
+    krefget(e->pa);
+    release(&pcache.lock);
+    __sync_fetch_and_add(&vmstats.exechits, 1);
+    return e->pa;
+  }
+  release(&pcache.lock);
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+
+  ilock(ip);
+  if(readi(ip, 0, (uint64)mem, off, n) != n){
+    iunlock(ip);
+    kfree(mem);
+    return 0;
+  }
+
+  // insert while ip is locked, so that a write
+  // can't slip in and leave a stale page cached.
+  acquire(&pcache.lock);
+  if((e = execlookup(ip, off, n)) != 0){
+    // another process read it first.
+    old = mem;
+    mem = e->pa;
+  } else {
+    e = &pcache.pg[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NEXECPAGE;
+    if(e->inum)
+      old = e->pa;
+    e->dev = ip->dev;
+    e->inum = ip->inum;
+    e->off = off;
+    e->n = n;
+    e->pa = mem;
+  }
+  krefget(mem);
+  release(&pcache.lock);
+  ip->paged = 1;
+  iunlock(ip);
+
+  if(old)
+    kfree(old);
+  return mem;
+}
+
+// Drop ip's pages from the exec page cache,
+// because its contents are about to change.
+// Caller must hold ip->lock.
+void
+execinval(struct inode *ip)
+{
+  char *old[NEXECPAGE];
+  int n = 0;
+
+  acquire(&pcache.lock);
+  for(struct execpage *e = pcache.pg; e < pcache.pg+NEXECPAGE; e++){
+    if(e->inum == ip->inum && e->dev == ip->dev){
+      old[n++] = e->pa;
+      e->inum = 0;
+      e->pa = 0;
+    }
+  }
+  release(&pcache.lock);
+  ip->paged = 0;
+
+  for(int i = 0; i < n; i++)
+    kfree(old[i]);
+}
+
+// Map the page of p's executable that contains va.
+// Returns 0 if va is now mapped, -1 on failure,
+// and 1 if va is not in a demand-paged segment.
+// Reading the page in sleeps and takes the executable's inode
+// and buffer locks, so this fails if the caller holds a spinlock
+// or any sleep lock, which could deadlock; see uvmprefault().
+int
+execfault(struct proc *p, uint64 va, int write)
+{
+  struct execseg *s;
+  uint64 a, off;
+  pte_t *pte;
+  uint n;
+  char *mem;
+  int locked;
+
+  for(s = p->seg; s < p->seg + p->nseg; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      break;
+  if(s == p->seg + p->nseg)
+    return 1;
+  if(write)
+    return -1;  // demand-paged segments are all read-only
+
+  push_off();
+  locked = mycpu()->noff > 1;
+  pop_off();
+  if(locked || p->nsleeplocks > 0)
+    return -1;
+
+  a = PGROUNDDOWN(va);
+  if((pte = walk(p->pagetable, a, 0)) != 0 && (*pte & PTE_V))
+    return -1;  // mapped, but not with the needed permission
+  off = a - s->va;
+  n = 0;
+  if(off < s->filesz)
+    n = s->filesz - off < PGSIZE ? s->filesz - off : PGSIZE;
+  if((mem = execpage(p->execip, s->off + off, n)) == 0)
+    return -1;
+  if(mappages(p->pagetable, a, PGSIZE, (uint64)mem, s->perm|PTE_R|PTE_U) != 0){
+    kfree(mem);
+    return -1;
+  }
+  __sync_fetch_and_add(&vmstats.execfaults, 1);
+  return 0;
+}
+
 int
 exec(char *path, char **argv)
 {
@@ -26,8 +200,10 @@ exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *execip = 0, *oldexecip;
   struct proghdr ph;
+  struct execseg seg[NEXECSEG];
+  int nseg = 0;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -86,8 +262,23 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    if(ph.vaddr + ph.memsz > VDSO)
+      goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
+    if(ph.vaddr < sz)
+      goto bad;
+    if((ph.flags & ELF_PROG_FLAG_WRITE) == 0 && nseg < NEXECSEG){
+      // read-only: leave it for execfault().
+      seg[nseg].va = ph.vaddr;
+      seg[nseg].memsz = ph.memsz;
+      seg[nseg].off = ph.off;
+      seg[nseg].filesz = ph.filesz;
+      seg[nseg].perm = flags2perm(ph.flags);
+      nseg++;
+      sz = ph.vaddr + ph.memsz;
+      continue;
+    }
     uint64 sz1;
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
       goto bad;
@@ -95,6 +286,8 @@ exec(char *path, char **argv)
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
+  if(nseg > 0)
+    execip = idup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
@@ -107,6 +300,8 @@ exec(char *path, char **argv)
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
   uint64 sz1;
+  if(sz + 2*PGSIZE > VDSO)
+    goto bad;
   if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE, PTE_W)) == 0)
     goto bad;
   sz = sz1;
@@ -149,11 +344,20 @@ exec(char *path, char **argv)
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
+  oldexecip = p->execip;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->execip = execip;
+  memmove(p->seg, seg, sizeof(seg));
+  p->nseg = nseg;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldexecip){
+    begin_op();
+    iput(oldexecip);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -164,6 +368,11 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(execip){
+    begin_op();
+    iput(execip);
+    end_op();
+  }
   return -1;
 }
 
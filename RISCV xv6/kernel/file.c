@@ -11,6 +11,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "rusage.h"
 #include "proc.h"
 
 struct devsw devsw[NDEV];
@@ -126,6 +127,8 @@ fileread(struct file *f, uint64 addr, int n)
     panic("fileread");
   }
 
+  if(r > 0)
+    myproc()->ru.rbytes += r;
   return r;
 }
 
@@ -146,6 +149,10 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
+    // fault in the source first: writei() can't read in pages of
+    // an executable while it holds f->ip's lock and a buffer.
+    uvmprefault(myproc()->pagetable, addr, n);
+
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
     // i-node, indirect block, allocation blocks,
@@ -177,6 +184,8 @@ filewrite(struct file *f, uint64 addr, int n)
     panic("filewrite");
   }
 
+  if(ret > 0)
+    myproc()->ru.wbytes += ret;
   return ret;
 }
 
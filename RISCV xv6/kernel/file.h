@@ -21,6 +21,11 @@ struct inode {
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
+  uint ra_next;       // file block a sequential reader would read next
+  uint ra_win;        // read-ahead window, in blocks
+  uint ra_end;        // first file block not yet prefetched
+  int paged;          // may have pages in the exec page cache
+
   short type;         // copy of disk inode
   short major;
   short minor;
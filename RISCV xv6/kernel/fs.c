@@ -15,6 +15,7 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -22,6 +23,7 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -311,6 +313,10 @@ ilock(struct inode *ip)
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
     ip->valid = 1;
+    ip->ra_next = 0;
+    ip->ra_win = 0;
+    ip->ra_end = 0;
+    ip->paged = 1;      // not known, so be safe
     if(ip->type == 0)
       panic("ilock: no type");
   }
@@ -429,6 +435,8 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  if(ip->paged)
+    execinval(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -464,6 +472,45 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Sequential read-ahead for a read of file blocks first..last.
+// A read that starts where the previous one left off doubles the
+// window (up to RAMAX blocks) and starts the disk reading that many
+// blocks past last; any other read closes the window.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint first, uint last)
+{
+  uint blocknos[RAMAX];
+  uint bn, end, nblocks;
+  int n = 0;
+
+  if(first == ip->ra_next || first + 1 == ip->ra_next){
+    if(ip->ra_win == 0)
+      ip->ra_win = RAMIN;
+    else if(ip->ra_win < RAMAX)
+      ip->ra_win = min(2*ip->ra_win, RAMAX);
+  } else {
+    ip->ra_win = 0;
+    ip->ra_end = 0;
+  }
+  ip->ra_next = last + 1;
+  if(ip->ra_win == 0)
+    return;
+
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+  end = min(last + 1 + ip->ra_win, nblocks);
+  for(bn = max(last + 1, ip->ra_end); bn < end && n < RAMAX; bn++){
+    uint addr = bmap(ip, bn);
+    if(addr == 0)
+      break;
+    blocknos[n++] = addr;
+  }
+  if(bn > ip->ra_end)
+    ip->ra_end = bn;
+  if(n > 0)
+    bprefetch(ip->dev, blocknos, n);
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -478,6 +525,8 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(n > 0 && ip->type == T_FILE)
+    readahead(ip, off/BSIZE, (off + n - 1)/BSIZE);
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     uint addr = bmap(ip, off/BSIZE);
@@ -512,6 +561,8 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->paged)
+    execinval(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     uint addr = bmap(ip, off/BSIZE);
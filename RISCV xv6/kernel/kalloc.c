@@ -1,6 +1,16 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Each CPU keeps a small cache of free pages that it allocates
+// from and frees into without touching any shared state. When a
+// cache runs dry it refills KBATCH pages at a time from the shared
+// pool (or, if that is empty, steals from another CPU's cache), and
+// when it grows past KCACHEMAX it drains KBATCH pages back, so the
+// shared kmem.lock is taken once per batch rather than once per page.
+//
+// Pages shared copy-on-write after fork() are reference counted;
+// kfree() only frees a page once its last reference is dropped.
 
 #include "types.h"
 #include "param.h"
@@ -8,6 +18,10 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "kstat.h"
+
+#define KBATCH     32           // pages moved between a cache and the pool
+#define KCACHEMAX  (2*KBATCH)   // drain a CPU cache once it holds this many
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -18,15 +32,41 @@ struct run {
   struct run *next;
 };
 
+// shared pool of free pages.
 struct {
   struct spinlock lock;
   struct run *freelist;
+  int nfree;
 } kmem;
 
+// per-CPU free page cache. the lock is only contended
+// when another CPU is stealing from this cache.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+
+  // statistics, only written by the owning CPU.
+  uint64 allocs;
+  uint64 frees;
+  uint64 refills;
+  uint64 drains;
+  uint64 steals;
+  uint64 contended;
+} __attribute__((aligned(64)));
+
+struct kcache kcache[NCPU];
+
+// references to each physical page, updated atomically.
+#define PA2REF(pa) (&pgref[((uint64)(pa) - KERNBASE) / PGSIZE])
+int pgref[(PHYSTOP - KERNBASE) / PGSIZE];
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +75,151 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    *PA2REF(p) = 1;
     kfree(p);
+  }
+}
+
+// Detach up to n pages from the front of *list.
+// Returns the detached chain and stores its length in *taken.
+static struct run*
+takepages(struct run **list, int n, int *taken)
+{
+  struct run *head, *tail;
+  int i;
+
+  head = *list;
+  if(head == 0){
+    *taken = 0;
+    return 0;
+  }
+  tail = head;
+  for(i = 1; i < n && tail->next; i++)
+    tail = tail->next;
+  *list = tail->next;
+  tail->next = 0;
+  *taken = i;
+  return head;
+}
+
+// Lock the shared pool, counting the acquisition as
+// contended if another CPU already holds it.
+static void
+lockpool(struct kcache *c)
+{
+  if(kmem.lock.locked)
+    c->contended++;
+  acquire(&kmem.lock);
+}
+
+// Refill CPU id's empty cache, first from the shared pool,
+// then by stealing half of another CPU's cache.
+// Caller must have interrupts disabled and not hold c->lock.
+static void
+refill(int id)
+{
+  struct kcache *c = &kcache[id];
+  struct run *chain, *r;
+  int n;
+
+  lockpool(c);
+  chain = takepages(&kmem.freelist, KBATCH, &n);
+  kmem.nfree -= n;
+  release(&kmem.lock);
+
+  if(chain)
+    c->refills++;
+
+  for(int i = 0; chain == 0 && i < NCPU; i++){
+    if(i == id)
+      continue;
+    struct kcache *victim = &kcache[i];
+    acquire(&victim->lock);
+    chain = takepages(&victim->freelist, (victim->nfree+1)/2, &n);
+    victim->nfree -= n;
+    release(&victim->lock);
+    if(chain)
+      c->steals++;
+  }
+
+  acquire(&c->lock);
+  while(chain){
+    r = chain;
+    chain = r->next;
+    r->next = c->freelist;
+    c->freelist = r;
+    c->nfree++;
+  }
+  release(&c->lock);
+}
+
+// Add a reference to the page at pa, which
+// must have been returned by kalloc().
+void
+krefget(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("krefget");
+  __sync_fetch_and_add(PA2REF(pa), 1);
 }
 
-// Free the page of physical memory pointed at by pa,
+// How many references the page at pa has.
+int
+krefcnt(void *pa)
+{
+  return __atomic_load_n(PA2REF(pa), __ATOMIC_SEQ_CST);
+}
+
+// Drop a reference to the page of physical memory pointed at by pa,
 // which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// call to kalloc(), and free it if that was the last one.
+// (The exception is when initializing the allocator; see kinit above.)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *chain = 0, *tail;
+  struct kcache *c;
+  int n = 0, ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((ref = __sync_sub_and_fetch(PA2REF(pa), 1)) > 0)
+    return;
+  if(ref < 0)
+    panic("kfree: ref");
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcache[cpuid()];
+
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->nfree++;
+  c->frees++;
+  if(c->nfree >= KCACHEMAX){
+    chain = takepages(&c->freelist, KBATCH, &n);
+    c->nfree -= n;
+    c->drains++;
+  }
+  release(&c->lock);
+
+  if(chain){
+    for(tail = chain; tail->next; tail = tail->next)
+      ;
+    lockpool(c);
+    tail->next = kmem.freelist;
+    kmem.freelist = chain;
+    kmem.nfree += n;
+    release(&kmem.lock);
+  }
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +229,55 @@ void *
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
+  int id;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  c = &kcache[id];
 
-  if(r)
+  acquire(&c->lock);
+  if(c->freelist == 0){
+    release(&c->lock);
+    refill(id);
+    acquire(&c->lock);
+  }
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->nfree--;
+    c->allocs++;
+  }
+  release(&c->lock);
+  pop_off();
+
+  if(r){
+    *PA2REF(r) = 1;
     memset((char*)r, 5, PGSIZE); // fill with junk
+  }
   return (void*)r;
 }
+
+// Gather allocator statistics for kstat().
+// Counters are read without locks, so the totals
+// are only approximate while other CPUs are allocating.
+void
+kmemstat(struct kmemstat *st)
+{
+  memset(st, 0, sizeof(*st));
+  st->nshared = kmem.nfree;
+  st->nfree = kmem.nfree;
+  for(int i = 0; i < NCPU; i++){
+    struct kcache *c = &kcache[i];
+    st->nfree += c->nfree;
+    st->allocs += c->allocs;
+    st->frees += c->frees;
+    st->refills += c->refills;
+    st->drains += c->drains;
+    st->steals += c->steals;
+    st->contended += c->contended;
+  }
+  for(char *p = (char*)PGROUNDUP((uint64)end); p < (char*)PHYSTOP; p += PGSIZE)
+    if(krefcnt(p) > 1)
+      st->cowpages++;
+}
@@ -0,0 +1,90 @@
+// Kernel statistics returned by the kstat() system call.
+// Both the kernel and user programs use this header file.
+
+#define KSTAT_KMEM    1   // physical page allocator
+#define KSTAT_BCACHE  2   // buffer cache
+#define KSTAT_DISK    3   // virtio disk queue
+#define KSTAT_RA      4   // file read-ahead
+#define KSTAT_LOG     5   // file system log
+#define KSTAT_VM      6   // user memory
+#define KSTAT_SCHED   7   // scheduler
+#define KSTAT_LOCK    8   // spinlocks, an array of struct lockstat
+
+struct kmemstat {
+  uint64 nfree;      // free pages in the shared pool and all CPU caches
+  uint64 nshared;    // free pages in the shared pool
+  uint64 allocs;     // kalloc() calls that returned a page
+  uint64 frees;      // kfree() calls
+  uint64 refills;    // batches moved from the shared pool into a CPU cache
+  uint64 drains;     // batches moved from a CPU cache into the shared pool
+  uint64 steals;     // batches stolen from another CPU's cache
+  uint64 contended;  // shared pool lock was already held when needed
+  uint64 cowpages;   // pages shared copy-on-write by more than one mapping
+};
+
+struct bcachestat {
+  uint64 nbuf;       // buffers in the cache
+  uint64 nbucket;    // hash buckets
+  uint64 hits;       // lookups that found the block cached
+  uint64 misses;     // lookups that had to recycle a buffer
+  uint64 evictions;  // buffers recycled by the clock hand
+};
+
+struct diskstat {
+  uint64 requests;   // requests handed to the device
+  uint64 blocks;     // blocks transferred by those requests
+  uint64 merged;     // requests that carried more than one block
+  uint64 reads;
+  uint64 writes;
+  uint64 depthsum;   // sum of queue depth seen at each submit
+  uint64 maxdepth;   // deepest the queue has been
+  uint64 inflight;   // requests in flight right now
+};
+
+struct rastat {
+  uint64 issued;     // blocks prefetched by read-ahead
+  uint64 hits;       // reads satisfied by a prefetched block
+  uint64 late;       // ...that still had to wait for the disk
+  uint64 wasted;     // prefetched blocks evicted before being read
+  uint64 misses;     // reads that waited on a synchronous disk read
+};
+
+struct logstat {
+  uint64 commits;    // transactions committed
+  uint64 blocks;     // blocks written by those transactions
+  uint64 ops;        // FS system calls grouped into them
+  uint64 maxops;     // most FS system calls in one transaction
+  uint64 waits;      // begin_op() sleeps for log space
+  uint64 time;       // time spent writing commits, in time CSR units
+  uint64 maxtime;    // longest single commit
+};
+
+struct vmstat {
+  uint64 cowcopies;     // copy-on-write faults that copied the page
+  uint64 cowreuses;     // ...that found it no longer shared
+  uint64 lazyreserved;  // pages sbrk() reserved without allocating
+  uint64 lazyfaulted;   // lazy pages allocated on first touch
+  uint64 execfaults;    // executable pages mapped on first touch
+  uint64 exechits;      // ...that were found in the exec page cache
+};
+
+struct schedstat {
+  uint64 switches;   // processes switched to by the schedulers
+  uint64 steals;     // ...that were taken from another CPU's run queue
+  uint64 idles;      // times a CPU found nothing to run and waited
+  uint64 boosts;     // run queues moved back to the top level
+  uint64 runnable;   // processes currently queued
+  uint64 wakeups;    // wakeup() calls that found a non-empty wait queue
+  uint64 wakescans;  // sleeping processes those calls looked at
+  uint64 sleepers;   // processes on wait queues now
+};
+
+// one per spinlock name; all locks with the same name are summed.
+struct lockstat {
+  char name[16];
+  uint64 acquires;   // acquire() calls
+  uint64 contended;  // ...that found the lock already held
+  uint64 spins;      // times round the spin loop waiting for it
+  uint64 holdtime;   // cycles the lock was held, in total
+  uint64 maxhold;    // longest single hold
+};
@@ -6,12 +6,13 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "kstat.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
+// calls. A transaction is closed only when there are no FS
+// system calls active in it. Thus there is never
 // any reasoning required about whether a commit might
 // write an uncommitted system call's updates to disk.
 //
@@ -19,7 +20,15 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the transaction it would join has been closed.
+//
+// The log is double-buffered. Closing a transaction copies its
+// blocks into log-private buffers (a snapshot), after which a new
+// transaction starts filling in the buffer cache while the closed
+// one is written to the log and installed from the snapshot.
+// Calls that end while a commit is in progress don't commit; the
+// committer picks up everything that has accumulated when it is
+// done (group commit).
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
@@ -42,9 +51,19 @@ struct log {
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int committing;  // a commit is in progress; end_op() leaves it to the committer.
+  int closing;     // the filling transaction is being snapshotted, please wait.
   int dev;
-  struct logheader lh;
+  struct logheader lh;          // the filling transaction
+  struct buf *pinned[LOGSIZE];  // its cached blocks, pinned until installed
+  int nops;                     // FS sys calls that joined it
+
+  // the committing transaction, owned by the committer.
+  struct logheader clh;
+  struct buf *cpinned[LOGSIZE];
+  struct buf snap[LOGSIZE];     // snapshot of its blocks
+
+  struct logstat stat;
 };
 struct log log;
 
@@ -61,12 +80,15 @@ initlog(int dev, struct superblock *sb)
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
+  for (int i = 0; i < LOGSIZE; i++)
+    initsleeplock(&log.snap[i].lock, "logsnap");
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// Only used by recovery; commit() installs from the snapshot.
 static void
-install_trans(int recovering)
+install_trans(void)
 {
   int tail;
 
@@ -75,8 +97,6 @@ install_trans(int recovering)
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
     brelse(lbuf);
     brelse(dbuf);
   }
@@ -96,18 +116,18 @@ read_head(void)
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
+// Write in-memory log header lh to disk.
 // This is the true point at which the
 // current transaction commits.
 static void
-write_head(void)
+write_head(struct logheader *lh)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
   bwrite(buf);
   brelse(buf);
@@ -117,9 +137,9 @@ static void
 recover_from_log(void)
 {
   read_head();
-  install_trans(1); // if committed, copy from log to disk
+  install_trans(); // if committed, copy from log to disk
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_head(&log.lh); // clear the log
 }
 
 // called at the start of each FS system call.
@@ -128,13 +148,15 @@ begin_op(void)
 {
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.closing){
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
+      log.stat.waits++;
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.nops += 1;
       release(&log.lock);
       break;
     }
@@ -142,7 +164,8 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation,
+// unless another call is already committing.
 void
 end_op(void)
 {
@@ -150,9 +173,9 @@ end_op(void)
 
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
+  if(log.closing)
+    panic("log.closing");
+  if(log.outstanding == 0 && log.lh.n > 0 && !log.committing){
     do_commit = 1;
     log.committing = 1;
   } else {
@@ -167,44 +190,96 @@ end_op(void)
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
     commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Move the filling transaction to the committer: copy its blocks
+// from the cache into the snapshot and empty log.lh so that a new
+// transaction can start. No FS sys calls are active in it, and
+// begin_op() waits while log.closing is set, so nothing can
+// modify the blocks while they are copied.
 static void
-write_log(void)
+snapshot(void)
 {
-  int tail;
+  int i;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  log.clh = log.lh;
+  for (i = 0; i < log.clh.n; i++) {
+    struct buf *b = log.pinned[i];
+    log.cpinned[i] = b;
+    acquiresleep(&b->lock);
+    memmove(log.snap[i].data, b->data, BSIZE);
+    releasesleep(&b->lock);
+  }
+}
+
+// Write the snapshot to blocks start+0 .. start+n-1,
+// or to the blocks' home locations if start is 0.
+static void
+write_snap(int start)
+{
+  struct buf *bs[LOGSIZE];
+  int i;
+
+  for (i = 0; i < log.clh.n; i++) {
+    struct buf *b = &log.snap[i];
+    b->dev = log.dev;
+    b->blockno = start ? start + i : log.clh.block[i];
+    acquiresleep(&b->lock);
+    bs[i] = b;
   }
+  bwritev(bs, log.clh.n);
+  for (i = 0; i < log.clh.n; i++)
+    releasesleep(&log.snap[i].lock);
 }
 
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
+  uint64 t0;
+  int i, n;
+
+  acquire(&log.lock);
+  while (log.lh.n > 0 && log.outstanding == 0) {
+    log.closing = 1;
+    release(&log.lock);
+    snapshot();
+    acquire(&log.lock);
+    log.stat.commits++;
+    log.stat.blocks += log.lh.n;
+    log.stat.ops += log.nops;
+    if (log.nops > log.stat.maxops)
+      log.stat.maxops = log.nops;
     log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+    log.nops = 0;
+    log.closing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    t0 = r_time();
+    write_snap(log.start+1); // Write the snapshot to the log
+    write_head(&log.clh);    // Write header to disk -- the real commit
+    write_snap(0);           // Now install writes to home locations
+    n = log.clh.n;
+    log.clh.n = 0;
+    write_head(&log.clh);    // Erase the transaction from the log
+    for (i = 0; i < n; i++)
+      bunpin(log.cpinned[i]);
+
+    t0 = r_time() - t0;
+    acquire(&log.lock);
+    log.stat.time += t0;
+    if (t0 > log.stat.maxtime)
+      log.stat.maxtime = t0;
   }
+  log.committing = 0;
+  wakeup(&log);
+  release(&log.lock);
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// commit() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -229,8 +304,18 @@ log_write(struct buf *b)
   log.lh.block[i] = b->blockno;
   if (i == log.lh.n) {  // Add new block to log?
     bpin(b);
+    log.pinned[i] = b;
     log.lh.n++;
   }
   release(&log.lock);
 }
 
+
+// Gather log statistics for kstat().
+void
+logstat(struct logstat *st)
+{
+  acquire(&log.lock);
+  *st = log.stat;
+  release(&log.lock);
+}
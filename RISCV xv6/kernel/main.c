@@ -27,6 +27,9 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    execinit();      // exec page cache
+    profinit();      // sampling profiler
+    vdsoinit();      // user-visible time page
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -8,6 +8,23 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#ifndef NBUF
+#define NBUF         (MAXOPBLOCKS*32)  // size of disk block cache
+#endif
+#define NBUCKET      61    // buffer cache hash buckets
+#define NPREFETCH    16    // max blocks per bprefetch() call
+#define RAMIN         2    // initial read-ahead window, in blocks
+#define RAMAX   NPREFETCH  // largest read-ahead window
+#ifndef PIPEPAGES
+#define PIPEPAGES     4    // pages of buffer per pipe, a power of two
+#endif
+#define NEXECSEG      4    // demand-paged ELF segments per process
+#define NEXECPAGE   128    // pages in the shared exec page cache
+#define NPRIO         3    // scheduler priority levels
+#define BOOSTTICKS   10    // ticks between priority boosts
+#define NWAITQ       64    // sleep/wakeup wait queues, hashed by channel
+#define TRACEPAGES    4    // pages of system call trace records per process
+#define NPROFSAMPLE 512    // profiler samples buffered per CPU
+#define NLOCKCLASS   32    // distinct spinlock names tracked by lock statistics
+#define FSSIZE       4000  // size of file system in blocks; fs.img uses ~2860
 #define MAXPATH      128   // maximum file path name
@@ -3,22 +3,53 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
+#define PIPESIZE (PIPEPAGES*PGSIZE)
+// nread and nwrite wrap at 2^32, which only divides
+// evenly into a ring whose size is a power of two.
+#if PIPEPAGES < 1 || (PIPEPAGES & (PIPEPAGES-1))
+#error "PIPEPAGES must be a power of two"
+#endif
+
+// The pipe's data lives in PIPEPAGES separately allocated pages,
+// used as one ring of PIPESIZE bytes. Readers and writers copy
+// as much as they can at a time, stopping only at page boundaries.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *pages[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+static void
+pipefree(struct pipe *pi)
+{
+  for(int i = 0; i < PIPEPAGES; i++)
+    if(pi->pages[i])
+      kfree(pi->pages[i]);
+  kfree((char*)pi);
+}
+
+// Where byte number off of the stream lives in the ring, and how
+// many bytes from there on are in the same page.
+static char*
+pipeaddr(struct pipe *pi, uint off, uint *room)
+{
+  uint i = off % PIPESIZE;
+
+  *room = PGSIZE - i % PGSIZE;
+  return pi->pages[i / PGSIZE] + i % PGSIZE;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,6 +61,10 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(pi->pages, 0, sizeof(pi->pages));
+  for(int i = 0; i < PIPEPAGES; i++)
+    if((pi->pages[i] = kalloc()) == 0)
+      goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -47,7 +82,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    pipefree(pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,7 +103,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    pipefree(pi);
   } else
     release(&pi->lock);
 }
@@ -77,8 +112,13 @@ int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
   int i = 0;
+  uint m, room;
+  char *dst;
   struct proc *pr = myproc();
 
+  // copyin() can't read in pages of the executable,
+  // say a string constant, with pi->lock held.
+  uvmprefault(pr->pagetable, addr, n);
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || killed(pr)){
@@ -89,11 +129,12 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+      dst = pipeaddr(pi, pi->nwrite, &room);
+      m = min(n - i, min(room, PIPESIZE - (pi->nwrite - pi->nread)));
+      if(copyin(pr->pagetable, dst, addr + i, m) == -1)
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      pi->nwrite += m;
+      i += m;
     }
   }
   wakeup(&pi->nread);
@@ -105,9 +146,10 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i = 0;
+  uint m, room;
+  char *src;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -117,12 +159,13 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  while(i < n && pi->nread != pi->nwrite){  //DOC: piperead-copy
+    src = pipeaddr(pi, pi->nread, &room);
+    m = min(n - i, min(room, pi->nwrite - pi->nread));
+    if(copyout(pr->pagetable, addr + i, src, m) == -1)
       break;
+    pi->nread += m;
+    i += m;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
@@ -3,13 +3,59 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
+#include "kstat.h"
+#include "syscall.h"
+#include "trace.h"
+#include "vdso.h"
 
 struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
 
+// Per-CPU run queues. Each keeps a FIFO of RUNNABLE processes for
+// each of NPRIO priority levels, linked through p->rqnext, and the
+// scheduler runs the first process of the highest non-empty level,
+// stealing from another CPU when its own queue is empty.
+// A process that is preempted by the timer drops a level, one that
+// wakes up from sleep goes back to the top, and every BOOSTTICKS
+// ticks all queued processes are moved to the top so that
+// CPU-bound processes can't starve.
+// Lock order: p->lock, then the run queue's lock.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  int n;                       // queued processes; read without the lock
+  uint lastboost;              // ticks at the last boost
+
+  // statistics, only written by the owning CPU.
+  uint64 switches;
+  uint64 steals;
+  uint64 idles;
+  uint64 boosts;
+} __attribute__((aligned(64)));
+
+struct runq runq[NCPU];
+
+// Sleeping processes wait on a queue chosen by hashing their
+// channel, so wakeup() only looks at processes that might be
+// sleeping on its channel rather than at the whole proc table.
+// Lock order: the wait queue's lock, then p->lock.
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;           // sleepers, through p->wqnext
+  int n;                       // queued processes; read without the lock
+
+  // statistics, written under the lock.
+  uint64 wakeups;
+  uint64 scans;
+} __attribute__((aligned(64)));
+
+struct waitq waitq[NWAITQ];
+
 struct proc *initproc;
 
 int nextpid = 1;
@@ -17,6 +63,7 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -51,6 +98,10 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -124,6 +175,10 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->prio = 0;
+  sysstatclear(p);
+  memset(&p->ru, 0, sizeof(p->ru));
+  memset(&p->cru, 0, sizeof(p->cru));
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -168,6 +223,9 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  tracefree(p);
+  p->execip = 0;
+  p->nseg = 0;
   p->state = UNUSED;
 }
 
@@ -202,6 +260,14 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the shared time page below that, readable by user code.
+  if(vdsomap(pagetable) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -212,6 +278,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, VDSO, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -249,7 +316,7 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
@@ -264,9 +331,13 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    // only reserve the address space; usertrap() allocates
+    // each page when it is first touched. The heap stops
+    // below the shared time page.
+    if(sz + n > VDSO)
       return -1;
-    }
+    lazyreserve(PGROUNDUP(sz + n) - PGROUNDUP(sz));
+    sz += n;
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
@@ -307,6 +378,10 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  if(p->execip)
+    np->execip = idup(p->execip);
+  memmove(np->seg, p->seg, sizeof(p->seg));
+  np->nseg = p->nseg;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -319,7 +394,7 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -351,6 +426,15 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  if(p->trace){
+    // exit() never returns to syscall(), so trace it here,
+    // whether it was called or the process was killed.
+    struct tracerec rec;
+    tracebegin(p, SYS_exit, &rec);
+    rec.args[0] = status;
+    traceend(p, &rec, status);
+  }
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -362,8 +446,11 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->execip)
+    iput(p->execip);
   end_op();
   p->cwd = 0;
+  p->execip = 0;
 
   acquire(&wait_lock);
 
@@ -385,20 +472,50 @@ exit(int status)
   panic("zombie exit");
 }
 
+// Add the counts in b to a.
+static void
+ruadd(struct rusage *a, struct rusage *b)
+{
+  a->utime += b->utime;
+  a->stime += b->stime;
+  a->nvcsw += b->nvcsw;
+  a->nivcsw += b->nivcsw;
+  a->faults += b->faults;
+  a->inblock += b->inblock;
+  a->oublock += b->oublock;
+  a->rbytes += b->rbytes;
+  a->wbytes += b->wbytes;
+}
+
 int
 wait(uint64 addr)
 {
-  return wait2(addr, 0);
+  return wait3(addr, 0, 0, 0);
+}
+
+int
+wait2(uint64 addr, uint64 res)
+{
+  return wait3(addr, res, 0, 0);
 }
 
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+// Copies out the exit status to addr, the child's system call
+// count to res (lab05), and the resources used by the child and
+// its descendants to ru, where each is non-zero.
+// With WNOHANG in options, return 0 instead of sleeping
+// if there are children but none has exited yet.
 int
-wait2(uint64 addr, uint64 res)
+wait3(uint64 addr, uint64 res, int options, uint64 ru)
 {
   struct proc *pp;
   int havekids, pid;
   struct proc *p = myproc();
+  struct rusage r;
+
+  if(options & ~WNOHANG)
+    return -1;
 
   acquire(&wait_lock);
 
@@ -414,6 +531,8 @@ wait2(uint64 addr, uint64 res)
         if(pp->state == ZOMBIE){
           // Found one.
           pid = pp->pid;
+          r = pp->ru;
+          ruadd(&r, &pp->cru);
           if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
                                   sizeof(pp->xstate)) < 0) {
             release(&pp->lock);
@@ -427,6 +546,13 @@ wait2(uint64 addr, uint64 res)
             release(&wait_lock);
             return -1;
           }
+          if(ru != 0 && copyout(p->pagetable, ru, (char *)&r, sizeof(r)) < 0){
+            release(&pp->lock);
+            release(&wait_lock);
+            return -1;
+          }
+          ruadd(&p->cru, &r);
+          sysstatreap(p, pp);
           freeproc(pp);
           release(&pp->lock);
           release(&wait_lock);
@@ -441,16 +567,116 @@ wait2(uint64 addr, uint64 res)
       release(&wait_lock);
       return -1;
     }
+    if(options & WNOHANG){
+      release(&wait_lock);
+      return 0;
+    }
     
     // Wait for a child to exit.
     sleep(p, &wait_lock);  //DOC: wait-sleep
   }
 }
 
+// Make p RUNNABLE and queue it on this CPU's run queue
+// at level p->prio.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  struct runq *rq;
+
+  push_off();
+  rq = &runq[cpuid()];
+  acquire(&rq->lock);
+  p->state = RUNNABLE;
+  p->rqnext = 0;
+  if(rq->tail[p->prio])
+    rq->tail[p->prio]->rqnext = p;
+  else
+    rq->head[p->prio] = p;
+  rq->tail[p->prio] = p;
+  rq->n++;
+  release(&rq->lock);
+  pop_off();
+}
+
+// Take the first process of the highest non-empty level off rq.
+// Caller must hold rq->lock.
+static struct proc*
+runqpop(struct runq *rq)
+{
+  struct proc *p;
+
+  for(int i = 0; i < NPRIO; i++){
+    if((p = rq->head[i]) != 0){
+      rq->head[i] = p->rqnext;
+      if(rq->head[i] == 0)
+        rq->tail[i] = 0;
+      p->rqnext = 0;
+      rq->n--;
+      return p;
+    }
+  }
+  return 0;
+}
+
+// Move every process queued on rq to the top level.
+// Caller must hold rq->lock.
+static void
+runqboost(struct runq *rq)
+{
+  for(int i = 1; i < NPRIO; i++){
+    if(rq->head[i] == 0)
+      continue;
+    for(struct proc *p = rq->head[i]; p; p = p->rqnext)
+      p->prio = 0;
+    if(rq->tail[0])
+      rq->tail[0]->rqnext = rq->head[i];
+    else
+      rq->head[0] = rq->head[i];
+    rq->tail[0] = rq->tail[i];
+    rq->head[i] = rq->tail[i] = 0;
+  }
+  rq->boosts++;
+}
+
+// Choose the next process for CPU id to run: the best one on
+// its own run queue, or failing that, one from another CPU's.
+static struct proc*
+pickproc(int id)
+{
+  struct runq *rq = &runq[id];
+  struct proc *p;
+
+  acquire(&rq->lock);
+  if(ticks - rq->lastboost >= BOOSTTICKS){
+    rq->lastboost = ticks;
+    runqboost(rq);
+  }
+  p = runqpop(rq);
+  release(&rq->lock);
+  if(p)
+    return p;
+
+  for(int i = 1; i < NCPU; i++){
+    struct runq *victim = &runq[(id + i) % NCPU];
+    if(victim->n == 0)
+      continue;
+    acquire(&victim->lock);
+    p = runqpop(victim);
+    release(&victim->lock);
+    if(p){
+      rq->steals++;
+      return p;
+    }
+  }
+  return 0;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run from the run queues.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -459,35 +685,57 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    int found_runnable = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found_runnable = 1;
-      }
-      release(&p->lock);
+    if((p = pickproc(id)) == 0){
+      runq[id].idles++;
+      asm volatile("wfi");
+      continue;
     }
 
-    if (found_runnable == 0) {
-      intr_on();
-      asm volatile("wfi");
+    // p was queued, so no other CPU can pick it, but the CPU
+    // that queued it may still be switching away from it and
+    // holding p->lock; that's fine, we wait for it here.
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      c->proc = p;
+      runq[id].switches++;
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
     }
+    release(&p->lock);
+  }
+}
+
+// Gather scheduler statistics for kstat().
+void
+schedstat(struct schedstat *st)
+{
+  memset(st, 0, sizeof(*st));
+  for(int i = 0; i < NCPU; i++){
+    struct runq *rq = &runq[i];
+    st->switches += rq->switches;
+    st->steals += rq->steals;
+    st->idles += rq->idles;
+    st->boosts += rq->boosts;
+    st->runnable += rq->n;
+  }
+  for(int i = 0; i < NWAITQ; i++){
+    st->wakeups += waitq[i].wakeups;
+    st->wakescans += waitq[i].scans;
+    st->sleepers += waitq[i].n;
   }
 }
 
@@ -519,12 +767,17 @@ sched(void)
 }
 
 // Give up the CPU for one scheduling round.
+// Only called when the timer preempts p, so p
+// drops to the next lower priority level.
 void
 yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  p->ru.nivcsw++;
+  if(p->prio < NPRIO-1)
+    p->prio++;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -550,13 +803,46 @@ forkret(void)
   usertrapret();
 }
 
+// The wait queue that processes sleeping on chan join.
+static struct waitq*
+waitqhash(void *chan)
+{
+  uint64 a = (uint64)chan;
+
+  return &waitq[((a >> 4) ^ (a >> 12)) % NWAITQ];
+}
+
+// Take p off wq, whose lock the caller must hold.
+static void
+waitqremove(struct waitq *wq, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &wq->head; *pp != p; pp = &(*pp)->wqnext)
+    ;
+  *pp = p->wqnext;
+  p->wq = 0;
+  wq->n--;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
-  
+  struct waitq *wq = waitqhash(chan);
+
+  // Join chan's wait queue while still holding lk, so that a
+  // wakeup() after we release lk is sure to find us. It can't
+  // look at us until we hold p->lock and are SLEEPING below.
+  acquire(&wq->lock);
+  p->wqnext = wq->head;
+  wq->head = p;
+  wq->n++;
+  p->wq = wq;
+  release(&wq->lock);
+
   // Must acquire p->lock in order to
   // change p->state and then call sched.
   // Once we hold p->lock, we can be
@@ -570,14 +856,24 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->ru.nvcsw++;
 
   sched();
 
   // Tidy up.
   p->chan = 0;
 
-  // Reacquire original lock.
+  // wakeup() takes us off the queue, but kill() doesn't.
+  // p->wq can't change once we're no longer SLEEPING.
+  int queued = p->wq != 0;
   release(&p->lock);
+  if(queued){
+    acquire(&wq->lock);
+    waitqremove(wq, p);
+    release(&wq->lock);
+  }
+
+  // Reacquire original lock.
   acquire(lk);
 }
 
@@ -586,17 +882,31 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
-
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
+  struct waitq *wq = waitqhash(chan);
+  struct proc *p, *next;
+
+  // a sleeper joins the queue while holding the lock that
+  // the caller holds (or held) to change the condition,
+  // so an empty queue here means no one is waiting.
+  if(__atomic_load_n(&wq->n, __ATOMIC_ACQUIRE) == 0)
+    return;
+
+  acquire(&wq->lock);
+  wq->wakeups++;
+  for(p = wq->head; p; p = next){
+    next = p->wqnext;
+    if(p == myproc())
+      continue;
+    wq->scans++;
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan) {
+      waitqremove(wq, p);
+      p->prio = 0;
+      setrunnable(p);
     }
+    release(&p->lock);
   }
+  release(&wq->lock);
 }
 
 // Kill the process with the given pid.
@@ -613,7 +923,8 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        p->prio = 0;
+        setrunnable(p);
       }
       release(&p->lock);
       return 0;
@@ -82,6 +82,16 @@ struct trapframe {
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
+// A read-only ELF segment that exec() left to be paged in
+// from the executable on first touch.
+struct execseg {
+  uint64 va;     // page-aligned start
+  uint64 memsz;
+  uint off;      // file offset
+  uint filesz;
+  int perm;      // PTE_X, if executable
+};
+
 struct proc {
   struct spinlock lock;
 
@@ -91,6 +101,10 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int prio;                    // Run queue level, 0 is highest
+  struct proc *rqnext;         // Next in run queue, under the run queue's lock
+  struct waitq *wq;            // Wait queue we are on while sleeping, if any
+  struct proc *wqnext;         // Next on that queue, under the wait queue's lock
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -104,7 +118,14 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct inode *execip;        // Executable, if any segments are demand-paged
+  struct execseg seg[NEXECSEG]; // Demand-paged segments of execip
+  int nseg;
+  int nsleeplocks;             // Sleep locks held, see execfault()
+
+  struct rusage ru;            // Resources used by this process
+  struct rusage cru;           // ...and by its reaped descendants, under wait_lock
 
-  int strace; // flag for strace (lab04)
+  struct tracering *trace; // system call trace records, if traced (lab04)
   int counter; // flag for lab05
 };
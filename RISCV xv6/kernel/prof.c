@@ -0,0 +1,129 @@
+// Sampling profiler.
+//
+// While profiling is on, each CPU records where it was at every
+// timer interrupt: the interrupted pc, whether that was in user
+// space, and the process it was running. Samples go into a
+// per-CPU buffer, so recording one never contends with another
+// CPU; when a buffer is full further samples on that CPU are
+// dropped until it is drained.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "defs.h"
+#include "prof.h"
+
+#define PROFBATCH 8   // samples copied out at a time
+
+struct profbuf {
+  struct spinlock lock;
+  struct profsample samples[NPROFSAMPLE];
+  int n;
+  uint64 lost;
+} __attribute__((aligned(64)));
+
+struct profbuf profbuf[NCPU];
+int profiling;
+
+void
+profinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&profbuf[i].lock, "prof");
+}
+
+// Record a sample of this CPU, interrupted at pc.
+// Called from devintr() on every timer interrupt,
+// with interrupts off.
+void
+profrecord(uint64 pc, int user)
+{
+  struct profbuf *b;
+  struct profsample *s;
+  struct proc *p;
+
+  if(!profiling)
+    return;
+  b = &profbuf[cpuid()];
+  p = myproc();
+  acquire(&b->lock);
+  if(b->n == NPROFSAMPLE){
+    b->lost++;
+  } else {
+    s = &b->samples[b->n++];
+    s->pc = pc;
+    s->cpu = cpuid();
+    s->user = user;
+    if(p){
+      s->pid = p->pid;
+      memmove(s->name, p->name, sizeof(s->name));
+    } else {
+      s->pid = 0;
+      safestrcpy(s->name, "idle", sizeof(s->name));
+    }
+  }
+  release(&b->lock);
+}
+
+// Copy up to n samples to addr in user space,
+// removing them from the buffers.
+// Returns the number copied, or -1.
+static int
+profdrain(uint64 addr, int n)
+{
+  struct profsample batch[PROFBATCH];
+  struct proc *p = myproc();
+  int got = 0, nb;
+
+  for(int i = 0; i < NCPU && got < n; i++){
+    struct profbuf *b = &profbuf[i];
+    for(;;){
+      acquire(&b->lock);
+      for(nb = 0; nb < PROFBATCH && got + nb < n && b->n > 0; nb++)
+        batch[nb] = b->samples[--b->n];
+      release(&b->lock);
+      if(nb == 0)
+        break;
+      // copyout() may sleep, so don't hold the lock.
+      if(copyout(p->pagetable, addr + got*sizeof(batch[0]), (char*)batch,
+                 nb*sizeof(batch[0])) < 0)
+        return -1;
+      got += nb;
+    }
+  }
+  return got;
+}
+
+// Start, stop or drain the profiler.
+// Stopping returns the number of samples dropped
+// because a buffer was full.
+int
+prof(int cmd, uint64 addr, int n)
+{
+  uint64 lost;
+
+  switch(cmd){
+  case PROF_START:
+    for(int i = 0; i < NCPU; i++){
+      acquire(&profbuf[i].lock);
+      profbuf[i].n = 0;
+      profbuf[i].lost = 0;
+      release(&profbuf[i].lock);
+    }
+    profiling = 1;
+    return 0;
+  case PROF_STOP:
+    profiling = 0;
+    lost = 0;
+    for(int i = 0; i < NCPU; i++)
+      lost += profbuf[i].lost;
+    return lost;
+  case PROF_DRAIN:
+    return profdrain(addr, n);
+  }
+  return -1;
+}
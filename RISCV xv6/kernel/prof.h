@@ -0,0 +1,14 @@
+// Profiler samples returned by the prof() system call.
+// Both the kernel and user programs use this header file.
+
+#define PROF_START  1   // discard old samples and start sampling
+#define PROF_STOP   2   // stop sampling, returns samples lost
+#define PROF_DRAIN  3   // copy out and remove samples
+
+struct profsample {
+  uint64 pc;            // sepc when the timer interrupt arrived
+  int pid;              // running process, 0 if the CPU was idle
+  short cpu;
+  short user;           // pc is a user address of process pid
+  char name[16];        // name of process pid
+};
@@ -0,0 +1,17 @@
+// Resource usage of a process, returned by the wait3() system call.
+// Both the kernel and user programs use this header file.
+
+// wait3() options
+#define WNOHANG 0x1  // don't sleep if no child has exited yet
+
+struct rusage {
+  uint64 utime;      // timer ticks spent running in user mode
+  uint64 stime;      // ...and in the kernel
+  uint64 nvcsw;      // voluntary context switches, i.e. sleeps
+  uint64 nivcsw;     // involuntary ones, i.e. preemptions
+  uint64 faults;     // page faults handled
+  uint64 inblock;    // blocks read from disk
+  uint64 oublock;    // blocks written to disk
+  uint64 rbytes;     // bytes read by read()
+  uint64 wbytes;     // bytes written by write()
+};
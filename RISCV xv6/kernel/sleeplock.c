@@ -6,6 +6,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "sleeplock.h"
 
@@ -27,6 +28,7 @@ acquiresleep(struct sleeplock *lk)
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  myproc()->nsleeplocks++;
   release(&lk->lk);
 }
 
@@ -36,6 +38,7 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  myproc()->nsleeplocks--;
   wakeup(lk);
   release(&lk->lk);
 }
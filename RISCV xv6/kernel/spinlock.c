@@ -1,19 +1,83 @@
 // Mutual exclusion spin locks.
+//
+// Every lock belongs to a class named by initlock(), and acquire()
+// and release() count acquisitions, spins and hold times per class.
+// The counters are kept per CPU and only touched with interrupts
+// off, so they need no locks or atomics of their own.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
+#include "kstat.h"
+
+struct lockcount {
+  uint64 acquires;
+  uint64 contended;
+  uint64 spins;
+  uint64 holdtime;
+  uint64 maxhold;
+};
+
+// lock class names. class 0 collects locks whose
+// name didn't fit once the table filled up.
+static char *classes[NLOCKCLASS] = { "other" };
+static int nclasses = 1;
+static uint classlock;   // protects classes; can't be a spinlock itself
+
+struct {
+  struct lockcount c[NLOCKCLASS];
+} __attribute__((aligned(64))) lockcounts[NCPU];
+
+// Find or add the class for locks called name.
+// Names are almost always string literals, so look for the same
+// pointer first, without classlock; classes are only ever added,
+// each published before nclasses counts it.
+static int
+lockclass(char *name)
+{
+  int i, n;
+
+  n = __atomic_load_n(&nclasses, __ATOMIC_ACQUIRE);
+  for(i = 1; i < n; i++)
+    if(classes[i] == name)
+      return i;
+
+  push_off();
+  while(__sync_lock_test_and_set(&classlock, 1) != 0)
+    ;
+  __sync_synchronize();
+  for(i = 1; i < nclasses; i++)
+    if(strncmp(classes[i], name, sizeof(((struct lockstat*)0)->name)) == 0)
+      break;
+  if(i == nclasses){
+    if(nclasses < NLOCKCLASS){
+      classes[nclasses] = name;
+      __atomic_store_n(&nclasses, nclasses + 1, __ATOMIC_RELEASE);
+    } else
+      i = 0;
+  }
+  __sync_lock_release(&classlock);
+  pop_off();
+  return i;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
+#ifdef TICKETLOCK
+  lk->next = 0;
+  lk->owner = 0;
+#endif
   lk->cpu = 0;
+  lk->cls = -1;  // looked up by the first acquire()
+  lk->start = 0;
 }
 
 // Acquire the lock.
@@ -21,16 +85,30 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  struct lockcount *lc;
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#ifdef TICKETLOCK
+  // Take a ticket (an amoadd.w) and wait for it to be served.
+  // Waiters only read owner while they spin, so the cache line
+  // is shared until the holder's release writes it, and the
+  // lock is handed out first come, first served.
+  uint ticket = __sync_fetch_and_add(&lk->next, 1);
+  while(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket)
+    spins++;
+  lk->locked = 1;
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    spins++;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +118,37 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  // holding lk, so no other acquire() sets cls at the same time.
+  if(lk->cls < 0)
+    lk->cls = lockclass(lk->name);
+  lc = &lockcounts[cpuid()].c[lk->cls];
+  lc->acquires++;
+  if(spins){
+    lc->contended++;
+    lc->spins += spins;
+  }
+  lk->start = r_cycle();
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  struct lockcount *lc;
+  uint64 t;
+
   if(!holding(lk))
     panic("release");
 
+  // a lock is always released on the CPU that acquired it,
+  // even when a context switch happens in between.
+  lc = &lockcounts[cpuid()].c[lk->cls];
+  t = r_cycle() - lk->start;
+  lc->holdtime += t;
+  if(t > lc->maxhold)
+    lc->maxhold = t;
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,6 +159,12 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#ifdef TICKETLOCK
+  // only the holder writes owner, so a plain
+  // increment is safe; serve the next ticket.
+  lk->locked = 0;
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +173,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
@@ -108,3 +215,33 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// Copy statistics for up to n lock classes to user address addr
+// for kstat(). Returns the number of bytes copied, or -1.
+// Counters are read without locks, so they are approximate.
+int
+lockstat(uint64 addr, int n)
+{
+  struct lockstat st;
+  int i, ncls;
+
+  if(n < 0)
+    return -1;
+  ncls = __atomic_load_n(&nclasses, __ATOMIC_SEQ_CST);
+  for(i = 0; i < ncls && (i+1)*sizeof(st) <= n; i++){
+    memset(&st, 0, sizeof(st));
+    safestrcpy(st.name, classes[i], sizeof(st.name));
+    for(int c = 0; c < NCPU; c++){
+      struct lockcount *lc = &lockcounts[c].c[i];
+      st.acquires += lc->acquires;
+      st.contended += lc->contended;
+      st.spins += lc->spins;
+      st.holdtime += lc->holdtime;
+      if(lc->maxhold > st.maxhold)
+        st.maxhold = lc->maxhold;
+    }
+    if(copyout(myproc()->pagetable, addr + i*sizeof(st), (char*)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return i * sizeof(st);
+}
@@ -1,9 +1,19 @@
 // Mutual exclusion lock.
+// Built with TICKETLOCK, waiters take a ticket and are served in
+// order; otherwise they race on an atomic swap of locked.
 struct spinlock {
   uint locked;       // Is the lock held?
+#ifdef TICKETLOCK
+  uint next;         // next ticket to hand out
+  uint owner;        // ticket now being served
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For lock statistics:
+  int cls;           // index into the lock classes, by name; -1 until first acquired
+  uint64 start;      // cycle counter when acquired
 };
 
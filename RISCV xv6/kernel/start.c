@@ -43,6 +43,12 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
+  // allow supervisor mode to read the cycle and time CSRs.
+  w_mcounteren(r_mcounteren() | 3);
+
+  // and user mode the time CSR, for nanotime() (see vdso.h).
+  w_scounteren(r_scounteren() | 2);
+
   // ask for clock interrupts.
   timerinit();
 
@@ -3,9 +3,22 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
+#include "sysstat.h"
+#include "trace.h"
+
+extern struct proc proc[NPROC];
+
+// system call statistics for each proc[] slot: its own calls,
+// and those of the children it has reaped. Only written by the
+// process itself, or by its parent once it is a zombie.
+struct {
+  struct sysstat self;
+  struct sysstat children;
+} sysstats[NPROC];
 
 // Fetch the uint64 at addr from the current process.
 int
@@ -108,6 +121,12 @@ extern uint64 sys_strace(void);
 extern uint64 sys_wait2(void);
 extern uint64 sys_benchmark_reset(void);
 extern uint64 sys_getcwd(void);
+extern uint64 sys_kstat(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_tracedrain(void);
+extern uint64 sys_prof(void);
+extern uint64 sys_wait3(void);
+extern uint64 sys_monotime(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -140,19 +159,95 @@ static uint64 (*syscalls[])(void) = {
 [SYS_wait2]   sys_wait2,
 [SYS_benchmark_reset] sys_benchmark_reset,
 [SYS_getcwd] sys_getcwd,
+[SYS_kstat]   sys_kstat,
+[SYS_sysstat] sys_sysstat,
+[SYS_tracedrain] sys_tracedrain,
+[SYS_prof]    sys_prof,
+[SYS_wait3]   sys_wait3,
+[SYS_monotime] sys_monotime,
 };
 
+// Count one call of num that took the given number of cycles.
+static void
+sysrecord(struct sysstat *st, int num, uint64 cycles)
+{
+  int b = 0;
+
+  if(num >= NSYSSTAT)
+    return;
+  for(uint64 c = cycles >> (SYSHISTSHIFT+1); c && b < NSYSHIST-1; c >>= 1)
+    b++;
+  st->count[num]++;
+  st->cycles[num] += cycles;
+  st->hist[num][b]++;
+}
+
+// Add the statistics in from to those in to.
+static void
+sysadd(struct sysstat *to, struct sysstat *from)
+{
+  for(int i = 0; i < NSYSSTAT; i++){
+    to->count[i] += from->count[i];
+    to->cycles[i] += from->cycles[i];
+    for(int j = 0; j < NSYSHIST; j++)
+      to->hist[i][j] += from->hist[i][j];
+  }
+}
+
+// Clear p's system call statistics, for a new process.
+void
+sysstatclear(struct proc *p)
+{
+  memset(&sysstats[p - proc], 0, sizeof(sysstats[0]));
+}
+
+// parent is reaping child: fold the child's statistics,
+// and those of everything it reaped, into parent's children.
+void
+sysstatreap(struct proc *parent, struct proc *child)
+{
+  struct sysstat *to = &sysstats[parent - proc].children;
+
+  sysadd(to, &sysstats[child - proc].self);
+  sysadd(to, &sysstats[child - proc].children);
+}
+
+// Copy the SYSSTAT_SELF or SYSSTAT_CHILDREN statistics
+// of the current process to addr in user space.
+int
+sysstatget(int who, uint64 addr)
+{
+  struct proc *p = myproc();
+  struct sysstat *st;
+
+  if(who == SYSSTAT_SELF)
+    st = &sysstats[p - proc].self;
+  else if(who == SYSSTAT_CHILDREN)
+    st = &sysstats[p - proc].children;
+  else
+    return -1;
+  return copyout(p->pagetable, addr, (char*)st, sizeof(*st));
+}
+
 void
 syscall(void)
 {
   int num;
+  uint64 start;
+  struct tracerec rec;
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    if(p->trace)
+      tracebegin(p, num, &rec);
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
+    start = r_cycle();
     p->trapframe->a0 = syscalls[num]();
+    sysrecord(&sysstats[p - proc].self, num, r_cycle() - start);
+    if(p->trace)
+      traceend(p, &rec, p->trapframe->a0);
     myproc()->counter++; // lab05, increment counter on successful syscall
   } else {
     printf("%d %s: unknown sys call %d\n",
@@ -27,3 +27,9 @@
 #define SYS_wait2 26
 #define SYS_benchmark_reset 27
 #define SYS_getcwd 28
+#define SYS_kstat 29
+#define SYS_sysstat 30
+#define SYS_tracedrain 31
+#define SYS_prof 32
+#define SYS_wait3 33
+#define SYS_monotime 34
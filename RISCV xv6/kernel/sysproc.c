@@ -4,9 +4,10 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
-#include "strace.h"
 #include "syscall.h"
+#include "kstat.h"
 
 
 uint64
@@ -14,7 +15,6 @@ sys_exit(void)
 {
   int n;
   argint(0, &n);
-  STRACE_ARGS("n = %d", n);
   exit(n);
   return 0;  // not reached
 }
@@ -22,46 +22,34 @@ sys_exit(void)
 uint64
 sys_getpid(void)
 {
-  STRACE();
-  uint64 res = myproc()->pid;
-  STRACE_RETURN(SYS_getpid);
-  return res;
+  return myproc()->pid;
 }
 
 uint64
 sys_fork(void)
 {
-  STRACE();
-  uint64 res = fork();
-  STRACE_RETURN(SYS_fork);
-  return res;
+  return fork();
 }
 
 uint64
 sys_wait(void)
 {
-  STRACE();
   uint64 p;
   argaddr(0, &p);
-  uint64 res = wait(p);
-  STRACE_RETURN(SYS_wait);
-  return res;
+  return wait(p);
 }
 
 uint64
 sys_sbrk(void)
 {
-  STRACE();
   uint64 addr;
   int n;
 
   argint(0, &n);
   addr = myproc()->sz;
   if(growproc(n) < 0) {
-    STRACE_RETURN(SYS_sbrk);
     return -1;
   }
-  STRACE_RETURN(SYS_sbrk);
   return addr;
 }
 
@@ -72,19 +60,16 @@ sys_sleep(void)
   uint ticks0;
 
   argint(0, &n);
-  STRACE_ARGS("n = %d", n);
   acquire(&tickslock);
   ticks0 = ticks;
   while(ticks - ticks0 < n){
     if(killed(myproc())){
       release(&tickslock);
-      STRACE_RETURN(SYS_sleep);
       return -1;
     }
     sleep(&ticks, &tickslock);
   }
   release(&tickslock);
-  STRACE_RETURN(SYS_sleep);
   return 0;
 }
 
@@ -94,10 +79,7 @@ sys_kill(void)
   int pid;
 
   argint(0, &pid);
-  STRACE_ARGS("pid = %d", pid);
-  uint64 res = kill(pid);
-  STRACE_RETURN(SYS_kill);
-  return res;
+  return kill(pid);
 }
 
 // return how many clock tick interrupts have occurred
@@ -105,13 +87,11 @@ sys_kill(void)
 uint64
 sys_uptime(void)
 {
-  STRACE();
   uint xticks;
 
   acquire(&tickslock);
   xticks = ticks;
   release(&tickslock);
-  STRACE_RETURN(SYS_uptime);
   return xticks;
 }
 
@@ -120,60 +100,179 @@ sys_uptime(void)
 uint64
 sys_shutdown(void)
 {
-  STRACE();
   volatile uint32 *test_dev = (uint32 *) VIRT_TEST;
   /* Hex memory location for shutdown */
   *test_dev = 0x5555;
-  STRACE_RETURN(SYS_shutdown);
   return 0;
 }
 
 uint64
 sys_reboot(void)
 {
-  STRACE();
   volatile uint32 *test_dev = (uint32 *) VIRT_TEST;
     /* Hex memory location for reboot */
   *test_dev = 0x7777;
-  STRACE_RETURN(SYS_reboot);
   return 0;
 }
 
 uint64
 sys_unixtime(void)
 {
-  STRACE();
   volatile uint64 *time_rtc = (uint64 *) GOLDFISH_RTC;
-  STRACE_RETURN(SYS_unixtime);
   return *time_rtc;
 }
 
+// nanoseconds since boot, from the time CSR.
+// user code can get the same from nanotime() without a trap.
+uint64
+sys_monotime(void)
+{
+  return monotime();
+}
+
+// start recording trace records for this process's system calls.
 uint64
 sys_strace(void)
 {
-  // not adding strace to the strace syscall in case there is some infinite loop
-  // from being too meta...
-  myproc()->strace = 1;
-  return 0;
+  return tracestart(myproc());
+}
+
+// copy up to n trace records of process pid to addr.
+uint64
+sys_tracedrain(void)
+{
+  int pid, n;
+  uint64 addr;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  argint(2, &n);
+  return tracedrain(pid, addr, n);
 }
 
 uint64
 sys_wait2(void)
 {
-  STRACE();
   uint64 p;
   uint64 count;
   argaddr(0, &p);
   argaddr(1, &count);
   uint64 res = wait2(p, count); // TODO! check this
-  STRACE_RETURN(SYS_wait2);
   return res;
 }
 
+// wait for a child, also returning the resources
+// used by it and its descendants.
+uint64
+sys_wait3(void)
+{
+  uint64 p, ru;
+  int options;
+
+  argaddr(0, &p);
+  argint(1, &options);
+  argaddr(2, &ru);
+  return wait3(p, 0, options, ru);
+}
+
 uint64
 sys_benchmark_reset(void)
 {
   myproc()->counter = 0;
+  sysstatclear(myproc());
   return 0;
 }
 
+// copy the calling process's system call statistics
+// (or its children's) to user space.
+uint64
+sys_sysstat(void)
+{
+  int who;
+  uint64 addr;
+
+  argint(0, &who);
+  argaddr(1, &addr);
+  return sysstatget(who, addr);
+}
+
+
+// copy the statistics for one kernel subsystem to user space.
+// returns the number of bytes copied, or -1 for an unknown kind.
+uint64
+sys_kstat(void)
+{
+  int kind, n;
+  uint64 addr;
+  union {
+    struct kmemstat kmem;
+    struct bcachestat bcache;
+    struct diskstat disk;
+    struct rastat ra;
+    struct logstat log;
+    struct vmstat vm;
+    struct schedstat sched;
+  } st;
+  int sz;
+
+  argint(0, &kind);
+  argaddr(1, &addr);
+  argint(2, &n);
+
+  switch(kind){
+  case KSTAT_KMEM:
+    kmemstat(&st.kmem);
+    sz = sizeof(st.kmem);
+    break;
+  case KSTAT_BCACHE:
+    bcachestat(&st.bcache);
+    sz = sizeof(st.bcache);
+    break;
+  case KSTAT_DISK:
+    virtio_disk_stat(&st.disk);
+    sz = sizeof(st.disk);
+    break;
+  case KSTAT_RA:
+    rastat(&st.ra);
+    sz = sizeof(st.ra);
+    break;
+  case KSTAT_LOG:
+    logstat(&st.log);
+    sz = sizeof(st.log);
+    break;
+  case KSTAT_VM:
+    vmstat(&st.vm);
+    sz = sizeof(st.vm);
+    break;
+  case KSTAT_SCHED:
+    schedstat(&st.sched);
+    sz = sizeof(st.sched);
+    break;
+  case KSTAT_LOCK:
+    // too big for the stack; copied out a class at a time.
+    return lockstat(addr, n);
+  default:
+    return -1;
+  }
+
+  if(n < 0)
+    return -1;
+  if(n < sz)
+    sz = n;
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sz) < 0)
+    return -1;
+  return sz;
+}
+
+// start, stop or drain the sampling profiler.
+uint64
+sys_prof(void)
+{
+  int cmd, n;
+  uint64 addr;
+
+  argint(0, &cmd);
+  argaddr(1, &addr);
+  argint(2, &n);
+  return prof(cmd, addr, n);
+}
@@ -0,0 +1,15 @@
+// Per-system-call statistics returned by the sysstat() system call.
+// Both the kernel and user programs use this header file.
+
+#define NSYSSTAT     40   // system call numbers tracked
+#define NSYSHIST     20   // latency histogram buckets
+#define SYSHISTSHIFT  8   // bucket i counts calls of 2^(i+8) .. 2^(i+9)-1 cycles
+
+#define SYSSTAT_SELF      0   // the calling process
+#define SYSSTAT_CHILDREN  1   // its waited-for children and their descendants
+
+struct sysstat {
+  uint64 count[NSYSSTAT];              // calls of each system call
+  uint64 cycles[NSYSSTAT];             // total cycles spent in each
+  uint hist[NSYSSTAT][NSYSHIST];       // log2 cycle histogram of each
+};
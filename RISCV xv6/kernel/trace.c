@@ -0,0 +1,180 @@
+// System call tracing.
+//
+// A process that calls strace() gets a ring of trace records,
+// spread over TRACEPAGES pages. syscall() appends one record per
+// system call it dispatches (exit() appends its own, since it
+// never returns), and a tracer reads them with tracedrain().
+// The traced process is the only writer and the tracer the only
+// reader, so appending takes no lock. When the ring is full new
+// records are dropped and counted rather than slowing the
+// traced process down, except that the last slot is saved for
+// the exit record.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "syscall.h"
+#include "defs.h"
+#include "trace.h"
+
+#define TRACEPERPAGE (PGSIZE / sizeof(struct tracerec))
+#define NTRACE       (TRACEPAGES * TRACEPERPAGE)
+#define TRACEBATCH   8     // records copied out at a time
+
+struct tracering {
+  uint head;             // records written, by the traced process
+  uint tail;             // records read, by the tracer
+  uint lost;             // records dropped since the last drain
+  struct tracerec *pages[TRACEPAGES];
+};
+
+extern struct proc proc[NPROC];
+
+static struct tracerec*
+ringrec(struct tracering *r, uint i)
+{
+  i %= NTRACE;
+  return &r->pages[i / TRACEPERPAGE][i % TRACEPERPAGE];
+}
+
+// Start tracing p's system calls.
+// Returns 0 on success, -1 if out of memory.
+int
+tracestart(struct proc *p)
+{
+  struct tracering *r;
+
+  if(p->trace)
+    return 0;
+  if((r = (struct tracering*)kalloc()) == 0)
+    return -1;
+  memset(r, 0, sizeof(*r));
+  for(int i = 0; i < TRACEPAGES; i++){
+    if((r->pages[i] = kalloc()) == 0){
+      p->trace = r;
+      tracefree(p);
+      return -1;
+    }
+  }
+  p->trace = r;
+  return 0;
+}
+
+// Free p's trace ring, when p is freed.
+void
+tracefree(struct proc *p)
+{
+  struct tracering *r = p->trace;
+
+  if(r == 0)
+    return;
+  p->trace = 0;
+  for(int i = 0; i < TRACEPAGES; i++)
+    if(r->pages[i])
+      kfree(r->pages[i]);
+  kfree(r);
+}
+
+// Does system call num take a path as its first argument?
+static int
+pathcall(int num)
+{
+  switch(num){
+  case SYS_exec: case SYS_open: case SYS_mknod: case SYS_unlink:
+  case SYS_link: case SYS_mkdir: case SYS_chdir:
+    return 1;
+  }
+  return 0;
+}
+
+// Save what a trace record needs from the arguments of
+// system call num before the call overwrites them.
+void
+tracebegin(struct proc *p, int num, struct tracerec *rec)
+{
+  rec->num = num;
+  rec->pid = p->pid;
+  rec->args[0] = p->trapframe->a0;
+  rec->args[1] = p->trapframe->a1;
+  rec->args[2] = p->trapframe->a2;
+  rec->str[0] = 0;
+  if(pathcall(num) && fetchstr(rec->args[0], rec->str, TRACESTR) < 0)
+    rec->str[0] = 0;
+}
+
+// Append rec, now that its call returned ret, to p's ring.
+// Called only by p itself.
+void
+traceend(struct proc *p, struct tracerec *rec, uint64 ret)
+{
+  struct tracering *r = p->trace;
+  uint room;
+
+  rec->ret = ret;
+  rec->time = r_time();
+  // the tracer waits for the exit record, so the last free
+  // slot is kept for it. A stale tail only makes this
+  // see less room than there is.
+  room = NTRACE - (r->head - r->tail);
+  if(room == 0 || (room == 1 && rec->num != SYS_exit)){
+    __sync_fetch_and_add(&r->lost, 1);
+    return;
+  }
+  *ringrec(r, r->head) = *rec;
+  __sync_synchronize();  // the record before the new head
+  r->head++;
+}
+
+// Copy up to n of the oldest trace records of process pid
+// to addr in user space. Returns the number copied, or -1
+// if pid isn't being traced.
+int
+tracedrain(int pid, uint64 addr, int n)
+{
+  struct tracerec batch[TRACEBATCH];
+  struct tracering *r;
+  struct proc *p, *me = myproc();
+  int got = 0, nb;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->trace)
+      break;
+    release(&p->lock);
+  }
+  if(p == &proc[NPROC])
+    return -1;
+
+  // holding p->lock keeps the ring from being freed.
+  r = p->trace;
+  while(got < n){
+    nb = 0;
+    if(r->lost){
+      memset(&batch[nb], 0, sizeof(batch[nb]));
+      batch[nb].num = TRACE_LOST;
+      batch[nb].pid = pid;
+      batch[nb].args[0] = __sync_lock_test_and_set(&r->lost, 0);
+      nb++;
+    }
+    __sync_synchronize();  // see the records before the head
+    while(nb < TRACEBATCH && nb < n - got && r->tail != r->head)
+      batch[nb++] = *ringrec(r, r->tail++);
+    if(nb == 0)
+      break;
+    // copyout() may sleep, so don't hold p->lock.
+    release(&p->lock);
+    if(copyout(me->pagetable, addr + got*sizeof(batch[0]), (char*)batch,
+               nb*sizeof(batch[0])) < 0)
+      return -1;
+    got += nb;
+    acquire(&p->lock);
+    if(p->pid != pid || p->trace != r)
+      break;
+  }
+  release(&p->lock);
+  return got;
+}
@@ -0,0 +1,15 @@
+// System call trace records, filled in by the kernel for
+// processes that called strace() and read by tracedrain().
+// Both the kernel and user programs use this header file.
+
+#define TRACESTR   32    // bytes of a path argument kept
+#define TRACE_LOST -1    // num of a record standing for args[0] dropped records
+
+struct tracerec {
+  uint64 time;           // time CSR when the call returned, see vdso.h
+  uint64 args[3];        // first three arguments
+  uint64 ret;            // return value, or exit status for exit
+  int pid;
+  int num;               // system call number
+  char str[TRACESTR];    // path argument, if the call takes one
+};
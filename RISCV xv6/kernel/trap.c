@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rusage.h"
 #include "proc.h"
 #include "defs.h"
 
@@ -67,6 +68,18 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // page fault. reading in a page of the executable
+    // may sleep, so turn on interrupts as for system calls.
+    uint64 scause = r_scause();
+    uint64 va = r_stval();
+    intr_on();
+    p->ru.faults++;
+    if(uvmfault(p, va, scause == 15) < 0){
+      printf("usertrap(): page fault scause %p pid=%d\n", scause, p->pid);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, va);
+      setkilled(p);
+    }
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -204,10 +217,18 @@ devintr()
   } else if(scause == 0x8000000000000001L){
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
+    struct proc *p = myproc();
 
     if(cpuid() == 0){
       clockintr();
     }
+
+    // charge this CPU's tick to whatever it was running.
+    if(p && (r_sstatus() & SSTATUS_SPP) == 0)
+      p->ru.utime++;
+    else if(p)
+      p->ru.stime++;
+    profrecord(r_sepc(), (r_sstatus() & SSTATUS_SPP) == 0);
     
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
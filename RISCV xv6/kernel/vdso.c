@@ -0,0 +1,41 @@
+// Time page.
+//
+// One page, filled in at boot, is mapped read-only at VDSO in
+// every process. It tells user code how fast the time CSR runs,
+// which start() lets user mode read, so nanotime() in ulib.c can
+// turn rdtime into nanoseconds without trapping into the kernel.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "defs.h"
+#include "vdso.h"
+
+struct vdso *vdso;
+
+void
+vdsoinit(void)
+{
+  if(VDSO != TRAPFRAME - PGSIZE)
+    panic("vdsoinit: layout");
+  if((vdso = kalloc()) == 0)
+    panic("vdsoinit");
+  memset(vdso, 0, PGSIZE);
+  vdso->timefreq = CLINT_FREQ;
+  vdso->boottime = *(volatile uint64*)GOLDFISH_RTC - vdsons(vdso, r_time());
+}
+
+// Map the time page into a new process's page table.
+int
+vdsomap(pagetable_t pagetable)
+{
+  return mappages(pagetable, VDSO, PGSIZE, (uint64)vdso, PTE_R | PTE_U);
+}
+
+// Nanoseconds since boot.
+uint64
+monotime(void)
+{
+  return vdsons(vdso, r_time());
+}
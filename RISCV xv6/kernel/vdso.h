@@ -0,0 +1,18 @@
+// The read-only page the kernel maps at VDSO in every process,
+// so that user code can tell the time without a system call.
+// Both the kernel and user programs use this header file.
+
+#define VDSO (0x4000000000L - 3*4096)  // MAXVA - 3*PGSIZE, below TRAPFRAME
+
+struct vdso {
+  uint64 timefreq;   // time CSR ticks per second
+  uint64 boottime;   // unix time in ns when the time CSR was 0
+};
+
+// ns since boot from a time CSR reading.
+static inline uint64
+vdsons(struct vdso *v, uint64 t)
+{
+  // split the multiply so it doesn't overflow.
+  return t / v->timefreq * 1000000000L + t % v->timefreq * 1000000000L / v->timefreq;
+}
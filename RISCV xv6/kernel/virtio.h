@@ -47,7 +47,11 @@
 
 // this many virtio descriptors.
 // must be a power of two.
-#define NUM 8
+#define NUM 64
+
+// most data blocks merged into a single disk request.
+// each request also needs a header and a status descriptor.
+#define MAXSEG 8
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -87,8 +91,8 @@ struct virtq_used {
 #define VIRTIO_BLK_T_OUT 1 // write the disk
 
 // the format of the first descriptor in a disk request.
-// to be followed by two more descriptors containing
-// the block, and a one-byte status.
+// to be followed by one descriptor per block of data
+// (up to MAXSEG), and a one-byte status.
 struct virtio_blk_req {
   uint32 type; // VIRTIO_BLK_T_IN or ..._OUT
   uint32 reserved;
@@ -15,6 +15,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "kstat.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -53,6 +54,9 @@ static struct disk {
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
+
+  int inflight;          // requests handed to the device, not yet done
+  struct diskstat stat;
   
   struct spinlock vdisk_lock;
   
@@ -196,12 +200,11 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -212,27 +215,27 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// queue one request covering the n (<= MAXSEG) consecutive
+// blocks in bs[]. caller holds disk.vdisk_lock.
+static void
+submit_req(struct buf **bs, int n, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  uint64 sector = bs[0]->blockno * (BSIZE / 512);
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // a descriptor for type/reserved/sector, then the data, then
+  // one for a 1-byte status result. the data may be split over
+  // several descriptors, one per buf here.
 
-  // allocate the three descriptors.
-  int idx[3];
+  int idx[MAXSEG+2];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(alloc_descs(idx, n+2) == 0) {
       break;
     }
     sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -249,24 +252,32 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(int i = 0; i < n; i++){
+    struct buf *b = bs[i];
+    if(b->blockno != bs[0]->blockno + i)
+      panic("virtio_disk_submit: blocks not consecutive");
+    disk.desc[idx[1+i]].addr = (uint64) b->data;
+    disk.desc[idx[1+i]].len = BSIZE;
+    if(write)
+      disk.desc[idx[1+i]].flags = 0; // device reads b->data
+    else
+      disk.desc[idx[1+i]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[idx[1+i]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[1+i]].next = idx[2+i];
+
+    // virtio_disk_intr() clears disk for every buf in the request.
+    b->disk = 1;
+    b->qnext = (i+1 < n) ? bs[i+1] : 0;
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the first struct buf for virtio_disk_intr().
+  disk.info[idx[0]].b = bs[0];
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -280,17 +291,52 @@ virtio_disk_rw(struct buf *b, int write)
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
+  disk.inflight++;
+  disk.stat.requests++;
+  disk.stat.blocks += n;
+  if(n > 1)
+    disk.stat.merged++;
+  if(write)
+    disk.stat.writes++;
+  else
+    disk.stat.reads++;
+  disk.stat.depthsum += disk.inflight;
+  if(disk.inflight > disk.stat.maxdepth)
+    disk.stat.maxdepth = disk.inflight;
+}
+
+// Start reading or writing the n bufs in bs[], which must hold
+// consecutive block numbers, without waiting for the disk.
+// Runs longer than MAXSEG are split over several requests.
+// The disk owns each buf (b->disk == 1) until the request
+// completes; use virtio_disk_wait() to wait for that.
+void
+virtio_disk_submit(struct buf **bs, int n, int write)
+{
+  acquire(&disk.vdisk_lock);
+  for(int i = 0; i < n; i += MAXSEG)
+    submit_req(bs + i, (n - i < MAXSEG) ? n - i : MAXSEG, write);
+  release(&disk.vdisk_lock);
+}
+
+// Wait for the request that b is part of to finish.
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
   while(b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
-
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
-
   release(&disk.vdisk_lock);
 }
 
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(&b, 1, write);
+  virtio_disk_wait(b);
+}
+
 void
 virtio_disk_intr()
 {
@@ -316,12 +362,32 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    struct buf *b, *next;
+    for(b = disk.info[id].b; b; b = next){
+      next = b->qnext;
+      b->qnext = 0;
+      b->disk = 0;   // disk is done with buf
+      wakeup(b);
+    }
+
+    // nobody waits on the request itself any more,
+    // so free its descriptors here.
+    disk.info[id].b = 0;
+    free_chain(id);
+    disk.inflight--;
 
     disk.used_idx += 1;
   }
 
   release(&disk.vdisk_lock);
 }
+
+// Gather disk queue statistics for kstat().
+void
+virtio_disk_stat(struct diskstat *st)
+{
+  acquire(&disk.vdisk_lock);
+  *st = disk.stat;
+  st->inflight = disk.inflight;
+  release(&disk.vdisk_lock);
+}
@@ -5,6 +5,11 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "rusage.h"
+#include "proc.h"
+#include "kstat.h"
+#include "vdso.h"
 
 /*
  * the kernel's page table.
@@ -15,6 +20,9 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// user memory statistics, updated atomically.
+struct vmstat vmstats;
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -172,7 +180,8 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never touched since sbrk()
+// reserved them have no mapping and are skipped.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -184,10 +193,8 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -305,8 +312,9 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Copies only the page table: the physical pages are
+// shared, and writable ones become read-only copy-on-write
+// pages in both tables, copied by uvmcow() on the first store.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
@@ -315,22 +323,20 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   pte_t *pte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
+  // the VDSO page above the heap is shared, not copied.
+  if(sz > VDSO)
+    panic("uvmcopy: sz");
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;  // not touched since sbrk()
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
-    }
+    krefget((void*)pa);
   }
   return 0;
 
@@ -339,6 +345,130 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Break copy-on-write sharing of the page at va: give this page
+// table a private, writable copy, or just make the page writable
+// again if no one else still shares it.
+// Returns 0 if va can now be written, -1 if it is not a
+// copy-on-write page or memory ran out.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || (*pte & PTE_COW) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefcnt((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    __sync_fetch_and_add(&vmstats.cowreuses, 1);
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  kfree((void*)pa);
+  __sync_fetch_and_add(&vmstats.cowcopies, 1);
+  return 0;
+}
+
+// Allocate the page at va if sbrk() reserved it (va is below sz)
+// but nothing has touched it yet. The page starts out zeroed.
+// Returns 0 if va is now mapped, -1 if it is not a lazy page
+// or memory ran out.
+int
+uvmlazy(pagetable_t pagetable, uint64 va, uint64 sz)
+{
+  pte_t *pte;
+  char *mem;
+
+  if(va >= sz || va >= VDSO)
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte = walk(pagetable, va, 0);
+  if(pte && (*pte & PTE_V))
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_U) != 0){
+    kfree(mem);
+    return -1;
+  }
+  __sync_fetch_and_add(&vmstats.lazyfaulted, 1);
+  return 0;
+}
+
+// Handle a fault on user address va of process p: break
+// copy-on-write sharing on a store, read in a page of the
+// executable, or allocate a page reserved by sbrk().
+// May sleep reading the executable.
+// Returns 0 if the access can be retried, -1 if it is a real fault.
+int
+uvmfault(struct proc *p, uint64 va, int write)
+{
+  int r;
+
+  if(va >= MAXVA)
+    return -1;
+  if(write && uvmcow(p->pagetable, va) == 0)
+    return 0;
+  if((r = execfault(p, va, write)) <= 0)
+    return r;
+  return uvmlazy(p->pagetable, va, p->sz);
+}
+
+// Like walkaddr(), but first fault in va if it is a page of
+// the current process that hasn't been touched yet, so that
+// copyin() and copyout() can use it.
+static uint64
+uvmaddr(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  pa = walkaddr(pagetable, va);
+  if(pa == 0 && p && p->pagetable == pagetable && uvmfault(p, va, write) == 0)
+    pa = walkaddr(pagetable, va);
+  return pa;
+}
+
+// Fault in the pages of [va, va+len) that copyin() will read,
+// for a caller about to copy while holding a spinlock, when
+// pages of the executable can't be read in. Stops at the first
+// bad page, which copyin() will reject in its turn.
+void
+uvmprefault(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  uint64 a;
+
+  for(a = PGROUNDDOWN(va); a < va + len && a < MAXVA; a += PGSIZE)
+    if(uvmaddr(pagetable, a, 0) == 0)
+      break;
+}
+
+// Count bytes of address space that sbrk() reserved without
+// allocating memory for them.
+void
+lazyreserve(uint64 bytes)
+{
+  __sync_fetch_and_add(&vmstats.lazyreserved, bytes / PGSIZE);
+}
+
+// Gather user memory statistics for kstat().
+void
+vmstat(struct vmstat *st)
+{
+  *st = vmstats;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -359,12 +489,22 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    if(va0 >= MAXVA)
+      return -1;
+    pte = walk(pagetable, va0, 0);
+    if(pte && (*pte & PTE_COW) && uvmcow(pagetable, va0) < 0)
+      return -1;
+    pa0 = uvmaddr(pagetable, va0, 1);
     if(pa0 == 0)
       return -1;
+    // demand-paged executable pages are shared; never write them.
+    pte = walk(pagetable, va0, 0);
+    if((*pte & PTE_W) == 0)
+      return -1;
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -387,7 +527,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -414,7 +554,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
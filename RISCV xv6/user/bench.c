@@ -0,0 +1,249 @@
+#include "../kernel/types.h"
+#include "../kernel/fcntl.h"
+#include "user.h"
+
+// Benchmark suite. Runs named scenarios a number of times after
+// a few untimed warmup runs, and reports the fastest, median and
+// 99th percentile time of one run of each, as a table or as CSV
+// for comparing kernels and builds.
+// usage: bench [-c] [-n iterations] [-w warmup] [scenario...]
+
+#define MAXITERS 1000
+#define PIPEBYTES (64 * 1024)
+#define NCHURN 256
+
+struct scenario {
+  char *name;
+  char *desc;
+  void (*run)(void);
+};
+
+char buf[4096];
+uint64 times[MAXITERS];
+void *blocks[NCHURN];
+
+void
+bench_error(char *err)
+{
+  fprintf(2, "bench error: %s\n", err);
+  exit(1);
+}
+
+void
+run_fork()
+{
+  int pid = fork();
+  if (pid < 0) {
+    bench_error("fork failed");
+  } else if (pid == 0) {
+    exit(0);
+  }
+  wait(0);
+}
+
+void
+run_exec()
+{
+  char *argv[] = { "bench", "-x", 0 };
+
+  int pid = fork();
+  if (pid < 0) {
+    bench_error("fork failed");
+  } else if (pid == 0) {
+    exec(argv[0], argv);
+    bench_error("exec failed");
+  }
+  wait(0);
+}
+
+void
+run_pipe()
+{
+  int fds[2];
+
+  if (pipe(fds) < 0) {
+    bench_error("pipe failed");
+  }
+  int pid = fork();
+  if (pid < 0) {
+    bench_error("fork failed");
+  } else if (pid == 0) {
+    close(fds[0]);
+    for (int sent = 0; sent < PIPEBYTES; sent += sizeof(buf)) {
+      write(fds[1], buf, sizeof(buf));
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  int got = 0, n;
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+    got += n;
+  }
+  close(fds[0]);
+  wait(0);
+  if (got != PIPEBYTES) {
+    bench_error("short pipe read");
+  }
+}
+
+void
+run_file()
+{
+  int fd = open("benchfile", O_CREATE | O_RDWR);
+  if (fd < 0) {
+    bench_error("cannot create benchfile");
+  }
+  if (write(fd, buf, 512) != 512) {
+    bench_error("write failed");
+  }
+  close(fd);
+  if (unlink("benchfile") < 0) {
+    bench_error("unlink failed");
+  }
+}
+
+void
+run_read()
+{
+  int fd = open("time-machine.txt", O_RDONLY);
+  if (fd < 0) {
+    bench_error("cannot open time-machine.txt");
+  }
+  while (read(fd, buf, sizeof(buf)) > 0)
+    ;
+  close(fd);
+}
+
+// allocate blocks of mixed sizes, free every other one, fill
+// the holes again and free everything.
+void
+run_malloc()
+{
+  for (int i = 0; i < NCHURN; i++) {
+    blocks[i] = malloc(16 + (i * 37) % 1000);
+  }
+  for (int i = 0; i < NCHURN; i += 2) {
+    free(blocks[i]);
+    blocks[i] = 0;
+  }
+  for (int i = 0; i < NCHURN; i += 2) {
+    blocks[i] = malloc(16 + (i * 53) % 2000);
+  }
+  for (int i = 0; i < NCHURN; i++) {
+    free(blocks[i]);
+  }
+}
+
+struct scenario scenarios[] = {
+  { "fork",   "fork, exit and wait",              run_fork },
+  { "exec",   "fork, exec and wait",              run_exec },
+  { "pipe",   "64KB through a pipe",              run_pipe },
+  { "file",   "create, write 512B, unlink",       run_file },
+  { "read",   "read time-machine.txt",            run_read },
+  { "malloc", "malloc and free churn",            run_malloc },
+};
+
+#define NSCENARIO (sizeof(scenarios) / sizeof(scenarios[0]))
+
+void
+sort(uint64 *a, int n)
+{
+  for (int i = 1; i < n; i++) {
+    uint64 v = a[i];
+    int j;
+    for (j = i; j > 0 && a[j - 1] > v; j--) {
+      a[j] = a[j - 1];
+    }
+    a[j] = v;
+  }
+}
+
+// Print ns as microseconds with two decimals.
+void
+print_us(uint64 ns)
+{
+  uint64 hundredths = ns / 10;
+  printf("%l.%l%l", hundredths / 100, hundredths / 10 % 10, hundredths % 10);
+}
+
+void
+run(struct scenario *s, int iters, int warmup, int csv)
+{
+  for (int i = 0; i < warmup; i++) {
+    s->run();
+  }
+  for (int i = 0; i < iters; i++) {
+    uint64 start = nanotime();
+    s->run();
+    times[i] = nanotime() - start;
+  }
+  sort(times, iters);
+
+  uint64 min = times[0];
+  uint64 median = times[iters / 2];
+  uint64 p99 = times[(iters * 99 - 1) / 100];
+  if (csv) {
+    printf("%s,%d,%l,%l,%l\n", s->name, iters, min, median, p99);
+    return;
+  }
+  printf("%s", s->name);
+  for (int len = strlen(s->name); len < 8; len++) {
+    printf(" ");
+  }
+  print_us(min);
+  printf("  ");
+  print_us(median);
+  printf("  ");
+  print_us(p99);
+  printf("  (%s)\n", s->desc);
+}
+
+int
+main(int argc, char **argv)
+{
+  int iters = 50, warmup = 3, csv = 0;
+  int i;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-x") == 0) {
+      exit(0); // the program exec runs
+    } else if (strcmp(argv[i], "-c") == 0) {
+      csv = 1;
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      iters = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      warmup = atoi(argv[++i]);
+    } else {
+      bench_error("invalid args");
+    }
+  }
+  if (iters < 1 || iters > MAXITERS || warmup < 0) {
+    bench_error("invalid iteration count");
+  }
+
+  if (csv) {
+    printf("scenario,iterations,min_ns,median_ns,p99_ns\n");
+  } else {
+    printf("times in us: min  median  p99\n");
+  }
+
+  if (i == argc) {
+    for (int s = 0; s < NSCENARIO; s++) {
+      run(&scenarios[s], iters, warmup, csv);
+    }
+    exit(0);
+  }
+  for (; i < argc; i++) {
+    int s;
+    for (s = 0; s < NSCENARIO; s++) {
+      if (strcmp(argv[i], scenarios[s].name) == 0) {
+        break;
+      }
+    }
+    if (s == NSCENARIO) {
+      bench_error(argv[i]);
+    }
+    run(&scenarios[s], iters, warmup, csv);
+  }
+  exit(0);
+}
@@ -1,16 +1,76 @@
 #include "user.h"
+#include "../kernel/sysstat.h"
+#include "../kernel/rusage.h"
+
+// Run a command and report how long it took, the resources it
+// and its children used, and how many system calls they made
+// and where their time went.
+// usage: benchmark command [args...]
+
+struct sysstat st;
 
 void benchmark_error(char* err) 
 {
   printf("benchmark error: %s\n", err);
 }
 
-void print_benchmark_results(uint64 time_elapsed, int count)
+void print_syscalls()
+{
+  if (sysstat(SYSSTAT_CHILDREN, &st) < 0) {
+    benchmark_error("sysstat failed");
+    return;
+  }
+
+  printf("syscall              calls    kcycles        avg       p50<       p99<\n");
+  for (int i = 0; i < NSYSSTAT; i++) {
+    if (st.count[i] == 0) {
+      continue;
+    }
+    char *name = sysname(i);
+    printf("%s", name);
+    for (int n = strlen(name); n < 16; n++) {
+      printf(" ");
+    }
+    print_column(st.count[i], 8);
+    print_column(st.cycles[i] / 1000, 10);
+    print_column(st.cycles[i] / st.count[i], 10);
+    print_column(percentile(st.hist[i], st.count[i], 50), 10);
+    print_column(percentile(st.hist[i], st.count[i], 99), 10);
+    printf("\n");
+  }
+}
+
+// Total system calls made by the command and its children.
+uint64 count_syscalls()
+{
+  uint64 count = 0;
+
+  if (sysstat(SYSSTAT_CHILDREN, &st) < 0) {
+    return 0;
+  }
+  for (int i = 0; i < NSYSSTAT; i++) {
+    count += st.count[i];
+  }
+  return count;
+}
+
+void print_rusage(struct rusage *ru)
+{
+  printf("CPU time: %l ticks user, %l ticks system\n", ru->utime, ru->stime);
+  printf("Context switches: %l voluntary, %l involuntary\n", ru->nvcsw, ru->nivcsw);
+  printf("Page faults: %l\n", ru->faults);
+  printf("Disk blocks: %l read, %l written\n", ru->inblock, ru->oublock);
+  printf("File bytes: %l read, %l written\n", ru->rbytes, ru->wbytes);
+}
+
+void print_benchmark_results(uint64 time_elapsed, struct rusage *ru)
 {
   printf("------------------\n");
   printf("Benchmark Complete\n");
   printf("Time elapsed: %d ms\n", time_elapsed);
-  printf("System calls: %d\n", count);
+  print_rusage(ru);
+  printf("System calls: %l\n", count_syscalls());
+  print_syscalls();
 }
 
 int main(int argc, char** argv)
@@ -20,11 +80,11 @@ int main(int argc, char** argv)
     exit(1);
   }
 
-  benchmark_reset(); // reset proc counter to 0
+  benchmark_reset(); // reset proc counter and syscall stats to 0
 
   int pid = fork();
 
-  uint64 start = unixtime(), end = 0;
+  uint64 start = nanotime(), end = 0;
 
   if (pid < 0) {
     benchmark_error("fork failed");
@@ -34,10 +94,11 @@ int main(int argc, char** argv)
     benchmark_error("exec failed");
     exit(1);
   } else {
-    int status, syscall_count;
-    wait2(&status, &syscall_count);
-    end = unixtime();
-    print_benchmark_results((end - start) / 1000000, syscall_count);
+    int status;
+    struct rusage ru;
+    wait3(&status, 0, &ru);
+    end = nanotime();
+    print_benchmark_results((end - start) / 1000000, &ru);
   }
 
   return 0;
@@ -1,6 +1,9 @@
 #include "../kernel/types.h"
+#include "../kernel/param.h"
 #include "user.h"
 #include "../kernel/fcntl.h"
+#include "../kernel/rusage.h"
+#include "../kernel/stat.h"
 
 #define CD 1
 #define EXIT 2
@@ -19,26 +22,51 @@
 #define NO_END 0
 
 #define BUFFER_SIZE 128
+#define MAX_ARGS 32
 
 int cmd_num = 1;
 int exit_status = 0;
 bool scripting = false;
 char wd[BUFFER_SIZE];
+struct rusage last_usage; // resources used by the last program run, from wait3
+
+#define HISTORY_SIZE 100
+#define HISTORY_FILE "/.boogsh_hist" // at most DIRSIZ (14) characters
+#define PREFIX_DEPTH 16   // letters of a first word the prefix index goes to
+#define PREFIX_NODES 2048 // enough for HISTORY_SIZE words of PREFIX_DEPTH
 
 struct history_pair {
   char *command;
   int val;
   int time;
+  struct rusage usage;
+};
+
+// A node of the prefix index, a trie over the leading lowercase
+// letters of each command's first word, which is all that !prefix
+// can match. Children are kept as a list, linked through sibling.
+struct prefix_node {
+  char c;
+  ushort child;   // first child, 0 if none
+  ushort sibling; // next child of the same parent, 0 if none
+  int last;       // number of the newest command under this prefix
 };
 
 struct history {
-  struct history_pair pairs[BUFFER_SIZE];
+  struct history_pair pairs[HISTORY_SIZE]; // ring, oldest at pairs[head]
+  int head;
   int count; // to make sure history entries <= 100 (not always increasing)
   int total_count; // command # (always increasing)
+  struct prefix_node nodes[PREFIX_NODES]; // nodes[0] is the root
+  int nnodes;
+  int fd; // HISTORY_FILE, open for appending, or -1
 };
 
+struct history history; // too big for the stack
+
 void repeat_history(char *buf, struct history *h);
 int choose_cmd(char *buf, struct history *h);
+void run_program(char* buf, int background);
 
 void
 print_welcome()
@@ -125,8 +153,132 @@ int check_built_in(char *buf)
 void 
 init_history(struct history *h)
 {
+  h->head = 0;
   h->count = 0;
   h->total_count = 1;
+  h->nodes[0].child = 0;
+  h->nnodes = 1;
+  h->fd = -1;
+}
+
+// The i'th oldest command in the ring.
+struct history_pair *
+history_at(struct history *h, int i)
+{
+  return &h->pairs[(h->head + i) % HISTORY_SIZE];
+}
+
+// The command numbered val, or NULL if it isn't in the ring. The
+// ring holds consecutive numbers, so this is just an offset.
+char *
+find_num(struct history *h, int val)
+{
+  if (h->count == 0) {
+    return NULL;
+  }
+  int i = val - history_at(h, 0)->val;
+  if (i < 0 || i >= h->count) {
+    return NULL;
+  }
+  return history_at(h, i)->command;
+}
+
+// Make command val the newest under each prefix of cmd's first
+// word. Returns -1 if the index has run out of nodes.
+int
+index_prefix(struct history *h, char *cmd, int val)
+{
+  int n = 0;
+
+  h->nodes[0].last = val;
+  for (int d = 0; d < PREFIX_DEPTH && cmd[d] >= 'a' && cmd[d] <= 'z'; d++) {
+    int c = h->nodes[n].child;
+    while (c && h->nodes[c].c != cmd[d]) {
+      c = h->nodes[c].sibling;
+    }
+    if (!c) {
+      if (h->nnodes == PREFIX_NODES) {
+        return -1;
+      }
+      c = h->nnodes++;
+      h->nodes[c].c = cmd[d];
+      h->nodes[c].child = 0;
+      h->nodes[c].sibling = h->nodes[n].child;
+      h->nodes[n].child = c;
+    }
+    h->nodes[c].last = val;
+    n = c;
+  }
+  return 0;
+}
+
+// Rebuild the index from the ring alone, dropping the
+// nodes only commands that have left the ring used.
+void
+reindex(struct history *h)
+{
+  h->nodes[0].child = 0;
+  h->nnodes = 1;
+  for (int i = 0; i < h->count; i++) {
+    index_prefix(h, history_at(h, i)->command, history_at(h, i)->val);
+  }
+}
+
+// The newest command whose first word starts with prefix
+// (lowercase letters only), or NULL.
+char *
+find_prefix(struct history *h, char *prefix)
+{
+  int len = strlen(prefix);
+
+  if (len > PREFIX_DEPTH) { // longer than the index goes
+    for (int i = h->count - 1; i >= 0; i--) {
+      char *cmd = history_at(h, i)->command;
+      if (memcmp(cmd, prefix, len) == 0) {
+        return cmd;
+      }
+    }
+    return NULL;
+  }
+
+  int n = 0;
+  for (int d = 0; d < len; d++) {
+    n = h->nodes[n].child;
+    while (n && h->nodes[n].c != prefix[d]) {
+      n = h->nodes[n].sibling;
+    }
+    if (!n) {
+      return NULL;
+    }
+  }
+  // the newest command under a prefix is the last to leave the
+  // ring, so if it has gone every command under it has too.
+  return find_num(h, h->nodes[n].last);
+}
+
+// Put c in the ring, dropping the oldest command if it is full.
+struct history_pair *
+push_history(struct history *h, char *c)
+{
+  struct history_pair *p;
+
+  if (h->count == HISTORY_SIZE) {
+    p = &h->pairs[h->head];
+    free(p->command);
+    h->head = (h->head + 1) % HISTORY_SIZE;
+  } else {
+    p = history_at(h, h->count);
+    h->count++;
+  }
+  p->command = malloc(strlen(c) + 1);
+  strcpy(p->command, c);
+  p->val = h->total_count++;
+  p->time = 0;
+  memset(&p->usage, 0, sizeof(p->usage));
+  if (index_prefix(h, c, p->val) < 0) {
+    reindex(h);
+  }
+  return p;
 }
 
 bool
@@ -148,41 +300,86 @@ valid_cmd(char *c)
 }
 
 void 
-add_history(struct history *h, char *c, int time_taken)
+add_history(struct history *h, char *c, int time_taken, struct rusage *usage)
 {
   if (valid_cmd(c)) { // if the command is valid
-    if (h->count == 100) { // only storing 100 items in recent history
-      free(h->pairs[0].command);
-      for (int i = 0; i < 99; i++) {
-        h->pairs[i] = h->pairs[i+1];
+    struct history_pair *p = push_history(h, c);
+    p->time = time_taken;
+    p->usage = *usage;
+
+    if (h->fd >= 0) { // one write, so the line goes in whole
+      char line[BUFFER_SIZE + 1];
+      int len = strlen(c);
+      memmove(line, c, len);
+      line[len] = '\n';
+      write(h->fd, line, len + 1);
+    }
+  }
+}
+
+// Start with the commands from HISTORY_FILE, then keep it open so
+// each new one is appended as it is added. Once the file holds
+// more than twice what the ring does it is rewritten with just the
+// ring, so loading it stays quick.
+void
+load_history(struct history *h)
+{
+  int fd = open(HISTORY_FILE, O_RDONLY);
+  int lines = 0;
+
+  if (fd >= 0) {
+    struct stream *s = sopen(fd);
+    if (!s) {
+      panic("failed to allocate history stream");
+    }
+    char *line = NULL;
+    uint max = 0;
+    int len;
+    while ((len = sgetline(&line, &max, s)) > 0) {
+      if (line[len - 1] == '\n') {
+        line[--len] = '\0';
+      }
+      if (len < BUFFER_SIZE && valid_cmd(line)) {
+        push_history(h, line);
       }
-    } else {
-      h->count++;
+      lines++;
     }
-    h->pairs[h->count - 1].command = malloc(strlen(c) + 1);
-    strcpy(h->pairs[h->count - 1].command, c);
-    h->pairs[h->count - 1].val = h->total_count;
-    h->pairs[h->count - 1].time = time_taken;
-    
-    h->total_count++;
+    free(line);
+    sclose(s);
   }
+
+  if (lines > 2 * HISTORY_SIZE &&
+      (fd = open(HISTORY_FILE, O_WRONLY | O_CREATE | O_TRUNC)) >= 0) {
+    for (int i = 0; i < h->count; i++) {
+      char *c = history_at(h, i)->command;
+      write(fd, c, strlen(c));
+      write(fd, "\n", 1);
+    }
+    close(fd);
+  }
+  h->fd = open(HISTORY_FILE, O_WRONLY | O_CREATE | O_APPEND);
 }
 
 void 
 print_history(struct history *h, int print_time) 
 {
-  if (h->total_count == 0) {
+  if (h->count == 0) {
     boog_error("No command history to display");
     return;
   }
   
   if (print_time == NO_PRINT_TIME) {
     for (int i = 0; i < h->count; i++) {
-      printf("%d: %s\n", h->pairs[i].val, h->pairs[i].command);
+      struct history_pair *p = history_at(h, i);
+      printf("%d: %s\n", p->val, p->command);
     }
   } else {
     for (int i = 0; i < h->count; i++) {
-      printf("[%d|%dms] %s\n", h->pairs[i].val, h->pairs[i].time, h->pairs[i].command);
+      struct history_pair *p = history_at(h, i);
+      struct rusage *u = &p->usage;
+      printf("[%d|%dms|%l+%l ticks|%l faults|%l/%l blocks] %s\n",
+             p->val, p->time, u->utime, u->stime,
+             u->faults, u->inblock, u->oublock, p->command);
     }
   }
 }
@@ -190,12 +387,12 @@ print_history(struct history *h, int print_time)
 void
 repeat_history(char *buf, struct history *h)
 {
-  if (h->total_count == 0) {
+  if (h->count == 0) {
     boog_error("No previous command to repeat");
     return;
   }
   
-  char *prev_cmd = h->pairs[h->total_count - 1].command;
+  char *prev_cmd = history_at(h, h->count - 1)->command;
   choose_cmd(prev_cmd, h);
   /*
   * strcpy prev_cmd into buf so that when history prints,
@@ -212,19 +409,15 @@ search_by_num(char *buf, struct history *h)
   char arg_nums[BUFFER_SIZE];
   int j = 0;
   uint i = 1;
-  while (i < strlen(buf) && j < BUFFER_SIZE && buf[i] >= '0' && buf[i] <= '9') {
+  while (i < strlen(buf) && j < BUFFER_SIZE - 1 && buf[i] >= '0' && buf[i] <= '9') {
     arg_nums[j] = buf[i];
     i++;
     j++;
   }
 
+  arg_nums[j] = '\0';
   int val = atoi(arg_nums);
-  char *found_cmd = NULL;
-  for (int i = 0; i < h->count; i++) {
-    if (h->pairs[i].val == val) {
-      found_cmd = h->pairs[i].command;
-    }
-  }
+  char *found_cmd = find_num(h, val);
   
   if (!found_cmd) {
     fprintf(2, "%d: ", val);
@@ -243,42 +436,14 @@ search_by_cmd(char *buf, struct history *h)
   int j = 0;
   uint i = 1;
   
-  while (i < strlen(buf) && j < BUFFER_SIZE && (buf[i] >= 'a' && buf[i] <= 'z')) {
+  while (i < strlen(buf) && j < BUFFER_SIZE - 1 && (buf[i] >= 'a' && buf[i] <= 'z')) {
     arg_cmd[j] = buf[i];
     i++;
     j++;
   }
 
   arg_cmd[j] = '\0';
-  char *found_cmd = NULL;
-  for (int i = 0; i < h->count; i++) {
-    char *match = malloc(strlen(h->pairs[i].command) + 1);
-    strcpy(match, h->pairs[i].command); // get command to prepare to match
-
-    char *pos = strchr(match, ' ');
-    if (!pos) {
-      pos = strchr(match, '\n');
-    }
-
-    if (pos) {
-      *pos = '\0';
-    }
-
-    int matching_chars = 0;
-    int n = strlen(arg_cmd);
-
-    for (int ci = 0; ci < n; ci++) {
-      if (arg_cmd[ci] == match[ci]) {
-        matching_chars++;
-      }
-      if (matching_chars == n) {
-        found_cmd = h->pairs[i].command;
-        break;
-      }
-    }
-
-    free(match);
-  }
+  char *found_cmd = find_prefix(h, arg_cmd);
 
   if (!found_cmd) {
     fprintf(2, "%s: ", arg_cmd);
@@ -305,93 +470,49 @@ search_history(char* buf, struct history *h, int choice)
 
 struct command {
   char **tokens;
-  bool stdout_pipe;
   bool append;
   char *stdout_file;
   char *stdin_file;
   int token_count; // used for debugging
 };
 
-int
-execute_pipeline(struct command *cmd)
-{
-  if (!cmd->stdout_pipe) {
-    if (cmd->stdout_file) {
-      int fd;
-      if (cmd->append) {
-        fd = open(cmd->stdout_file, O_RDWR | O_CREATE | O_APPEND);
-      } else {
-        fd = open(cmd->stdout_file, O_RDWR | O_CREATE);
-      }
-      if (fd == -1) {
-        fprintf(2, "stdout file: %s\n", cmd->stdout_file);
-        panic("unable to open^^^");
-      }
-      if (close(1) == -1) {
-        panic("failed to close stdout");
-      }
-      if (dup(fd) == -1) {
-        panic("failed to dup fd for stdout");
-      }
-      if (close(fd) == -1) {
-        panic("failed to close fd after dup");
-      }
-    }
-    if (cmd->stdin_file) {
-      int fd = open(cmd->stdin_file, O_RDONLY);
-      if (fd == -1) {
-        fprintf(2, "stdin file: %s\n", cmd->stdin_file);
-        panic("unable to open^^^");
-      }
-      if (close(0) == -1) {
-        panic("failed to close stdin");
-      }
-      if (dup(fd) == -1) {
-        panic("failed to dup fd for stdin");
-      }
-      if (close(fd) == -1) {
-        panic("failed to close fd after dup");
-      }
-    }
-    exec(cmd->tokens[0], cmd->tokens);
-    fprintf(2, "failed to exec: %s with token count: %d\n", cmd->tokens[0], cmd->token_count);
-    return 1;
+// Point fd (0 or 1) at file, in a pipeline stage's child.
+void
+redirect(int fd, char *file, int mode)
+{
+  int ffd = open(file, mode);
+  if (ffd == -1) {
+    fprintf(2, "%s file: %s\n", fd == 0 ? "stdin" : "stdout", file);
+    panic("unable to open^^^");
   }
-  
-  int fd[2];
-  pipe(fd);
-  int pid = pork("failed to fork child process in execute_pipeline");
-  if (pid > 0) { // parent
-    if (close(fd[1]) == -1) {
-      panic("failed to close out-end of pipe in parent");
-    }
-    if (close(0) == -1) {
-      panic("failed to close stdin in parent");
-    }
-    if (dup(fd[0]) == -1) {
-      panic("failed to dup in-end of pipe in parent");
-    }
-    execute_pipeline(cmd + 1);
-    wait(0);
-  } else if (pid == 0) { // child
-    if (close(fd[0]) == -1) {
-      panic("failed to close in-end of pipe in child");
-    }
-    if (close(1) == -1) {
-      panic("failed to close stdout in child");
-    }
-    if (dup(fd[1]) == -1) {
-      panic("failed to dup out-end of pipe in child");
-    }
-    exec(cmd->tokens[0], cmd->tokens);
-    fprintf(2, "failed to exec: %s in pipeline with token count: %d\n", cmd->tokens[0], cmd->token_count);
-    exit(1);
+  if (close(fd) == -1) {
+    panic("failed to close std fd");
+  }
+  if (dup(ffd) == -1) {
+    panic("failed to dup fd for redirection");
+  }
+  if (close(ffd) == -1) {
+    panic("failed to close fd after dup");
   }
-  return 0;
 }
 
+// Move pipe end from onto fd (0 or 1), in a pipeline stage's child.
 void
-parse_and_run_cmd(char *s)
+use_pipe(int fd, int from)
+{
+  if (close(fd) == -1) {
+    panic("failed to close std fd in pipeline stage");
+  }
+  if (dup(from) == -1) {
+    panic("failed to dup pipe end in pipeline stage");
+  }
+  close(from);
+}
+
+// Split s, which is modified, into pipeline stages.
+// Returns the stages and stores how many there are in *n.
+struct command *
+parse_cmds(char *s, int *n)
 {
   int cap = 2; // size cap of cmds
   int sz = 0; // current size of cmds
@@ -400,97 +521,647 @@ parse_and_run_cmd(char *s)
 
   char *tok; // whole token chunk
   char *part; // token pieces
-  bool found_in = false;
-  bool found_out = false;
-    
+
   while ((tok = next_token(&s, "|"))) {
-     if (sz == cap - 1) {
-       cap *= 2;
-       struct command *tmp = malloc(cap * sizeof(struct command));
-       if (!tmp) panic("failed to create tmp array with malloc");
-       memcpy(tmp, cmds, sizeof(struct command) * sz);
-       free(cmds);
-       cmds = tmp;
-     }
-
-    cmds[sz].tokens = malloc(sizeof(char *) * (strlen(tok))); // tokens array
-    // so stdin_file or stdout_file don't get overwritten accidentally
-    found_in = false;
-    found_out = false;
-    
-    int curr_tok_idx = 0;
-    char *file = NULL;
+    if (sz == cap) {
+      cap *= 2;
+      struct command *tmp = malloc(cap * sizeof(struct command));
+      if (!tmp) panic("failed to create tmp array with malloc");
+      memcpy(tmp, cmds, sizeof(struct command) * sz);
+      free(cmds);
+      cmds = tmp;
+    }
 
+    cmds[sz].tokens = malloc(sizeof(char *) * (strlen(tok) + 1)); // tokens array
     cmds[sz].stdin_file = NULL;
     cmds[sz].stdout_file = NULL;
-    cmds[sz].stdout_pipe = true;
     cmds[sz].append = false;
-    
+
+    int curr_tok_idx = 0;
+    char *file = NULL;
+
     while ((part = next_token(&tok, " "))) {
-      if (strcmp(part, ">") == 0) {
+      if (strcmp(part, ">") == 0 || strcmp(part, ">>") == 0) {
         file = next_token(&tok, " ");
-        if (!file) panic("no file present after \'>\'");
-        if (!found_in) {
-          cmds[sz].stdin_file = NULL;
+        if (!file) {
+          fprintf(2, "no file present after \'%s\'\n", part);
+          break;
         }
-        cmds[sz].stdout_pipe = false;
+        cmds[sz].append = part[1] == '>';
         cmds[sz].stdout_file = file;
-        cmds[sz].stdout_pipe = false;
-        found_out = true;
         continue;
       } else if (strcmp(part, "<") == 0) {
         file = next_token(&tok, " ");
-        if (!file) panic("no file present after \'<\'");
-        if (!found_out) {
-          cmds[sz].stdout_file = NULL;
+        if (!file) {
+          fprintf(2, "no file present after \'<\'\n");
+          break;
         }
-        cmds[sz].stdout_pipe = false;
         cmds[sz].stdin_file = file;
-        cmds[sz].stdout_pipe = false;
-        found_in = true;
-        continue;
-      } else if (strcmp(part, ">>") == 0) {
-        file = next_token(&tok, " ");
-        if (!file) panic("no file present after \'>>\'");
-        if (!found_in) {
-          cmds[sz].stdin_file = NULL;
-        }
-        cmds[sz].stdout_pipe = false;
-        cmds[sz].stdout_file = file;
-        cmds[sz].stdout_pipe = false;
-        cmds[sz].append = true;
         continue;
       }
       cmds[sz].tokens[curr_tok_idx++] = part;
     }
+    cmds[sz].tokens[curr_tok_idx] = NULL;
     cmds[sz].token_count = curr_tok_idx;
     sz++;
+    if (part) { // stopped at a redirection missing its file
+      for (int i = 0; i < sz; i++) {
+        free(cmds[i].tokens);
+      }
+      exit_status = 1;
+      sz = 0;
+      break;
+    }
+  }
+
+  *n = sz;
+  return cmds;
+}
+
+// Fork and exec one stage of a pipeline, reading from in (or
+// stdin) and writing to out (or stdout). The shell's other pipe
+// ends, which the child must not hold open, are closed in it.
+int
+spawn_stage(struct command *cmd, int in, int out, int other)
+{
+  int pid = pork("failed to fork pipeline stage");
+  if (pid > 0) {
+    return pid;
   }
 
-  cmds[sz - 1].stdout_pipe = false; // end pipeline
-  int status = execute_pipeline(cmds); // run the pipeline
-  if (status == 1) {
+  // there is no close-on-exec, so don't hand the program
+  // a writable descriptor for the history file.
+  if (history.fd >= 0) {
+    close(history.fd);
+  }
+  if (other != -1) {
+    close(other);
+  }
+  if (cmd->stdin_file) {
+    if (in != -1) close(in);
+    redirect(0, cmd->stdin_file, O_RDONLY);
+  } else if (in != -1) {
+    use_pipe(0, in);
+  }
+  if (cmd->stdout_file) {
+    if (out != -1) close(out);
+    redirect(1, cmd->stdout_file, O_RDWR | O_CREATE | (cmd->append ? O_APPEND : 0));
+  } else if (out != -1) {
+    use_pipe(1, out);
+  }
+  if (cmd->token_count == 0) {
+    fprintf(2, "empty command in pipeline\n");
     exit(1);
   }
-  exit(0);
+  exec(cmd->tokens[0], cmd->tokens);
+  fprintf(2, "failed to exec: %s with token count: %d\n", cmd->tokens[0], cmd->token_count);
+  exit(1);
+}
+
+/*
+ * Jobs. Every pipeline the shell starts is a job until all of its
+ * stages have been reaped. A foreground job is waited for straight
+ * away; a background one (a trailing &) is numbered, %N, and its
+ * stages are reaped with WNOHANG before each prompt or script
+ * line, or whenever the shell waits for something else and one of
+ * them happens to exit first.
+ */
+
+#define MAX_JOBS 16
+
+struct job {
+  bool used;
+  bool background;
+  int seq;        // order started in, so fg and bg find the newest
+  char *cmd;
+  int *pids;      // one per stage
+  int *statuses;  // exit status of each stage, -1 until reaped
+  int n;          // stages
+  int left;       // stages started but not reaped yet
+  struct rusage usage; // summed over the reaped stages
+};
+
+struct job jobs[MAX_JOBS]; // job %N is jobs[N - 1]
+int job_seq = 0;
+
+struct job *
+alloc_job(char *cmd, int n, bool background)
+{
+  for (int i = 0; i < MAX_JOBS; i++) {
+    struct job *j = &jobs[i];
+    if (j->used) {
+      continue;
+    }
+    j->used = true;
+    j->background = background;
+    j->seq = job_seq++;
+    j->cmd = malloc(strlen(cmd) + 1);
+    strcpy(j->cmd, cmd);
+    j->pids = malloc(sizeof(int) * (n + 1));
+    j->statuses = malloc(sizeof(int) * (n + 1));
+    for (int k = 0; k < n; k++) {
+      j->pids[k] = 0;
+      j->statuses[k] = -1;
+    }
+    j->n = n;
+    j->left = 0;
+    memset(&j->usage, 0, sizeof(j->usage));
+    return j;
+  }
+  return NULL;
+}
+
+void
+free_job(struct job *j)
+{
+  free(j->cmd);
+  free(j->pids);
+  free(j->statuses);
+  j->used = false;
+}
+
+int
+job_id(struct job *j)
+{
+  return j - jobs + 1;
+}
+
+void
+add_usage(struct rusage *to, struct rusage *from)
+{
+  to->utime += from->utime;
+  to->stime += from->stime;
+  to->nvcsw += from->nvcsw;
+  to->nivcsw += from->nivcsw;
+  to->faults += from->faults;
+  to->inblock += from->inblock;
+  to->oublock += from->oublock;
+  to->rbytes += from->rbytes;
+  to->wbytes += from->wbytes;
+}
+
+// Reap one child and credit it to the job it is a stage of.
+// Returns its pid, 0 if options has WNOHANG and no child has
+// exited yet, or -1 if there are no children left.
+int
+reap_one(int options)
+{
+  int status;
+  struct rusage usage;
+  int pid = wait3(&status, options, &usage);
+  if (pid <= 0) {
+    return pid;
+  }
+
+  for (int i = 0; i < MAX_JOBS; i++) {
+    struct job *j = &jobs[i];
+    for (int k = 0; j->used && k < j->n; k++) {
+      if (j->pids[k] == pid) {
+        j->statuses[k] = status;
+        j->left--;
+        add_usage(&j->usage, &usage);
+        return pid;
+      }
+    }
+  }
+  return pid;
+}
+
+// Wait until every started stage of j has exited.
+void
+wait_job(struct job *j)
+{
+  while (j->left > 0 && reap_one(0) > 0)
+    ;
+}
+
+// Reap whatever has exited without waiting, and report
+// (and forget) the background jobs that are now done.
+void
+reap_jobs()
+{
+  while (reap_one(WNOHANG) > 0)
+    ;
+  for (int i = 0; i < MAX_JOBS; i++) {
+    struct job *j = &jobs[i];
+    if (j->used && j->background && j->left == 0) {
+      printf("[%d] Done (%d) %s\n", job_id(j), j->statuses[j->n - 1], j->cmd);
+      free_job(j);
+    }
+  }
+}
+
+// The background job named by spec, "%N" or "N", or the
+// newest one if spec is NULL.
+struct job *
+find_job(char *spec)
+{
+  struct job *found = NULL;
+
+  if (spec) {
+    int id = atoi(spec[0] == '%' ? spec + 1 : spec);
+    if (id < 1 || id > MAX_JOBS) {
+      return NULL;
+    }
+    found = &jobs[id - 1];
+    return found->used && found->background ? found : NULL;
+  }
+  for (int i = 0; i < MAX_JOBS; i++) {
+    struct job *j = &jobs[i];
+    if (j->used && j->background && (!found || j->seq > found->seq)) {
+      found = j;
+    }
+  }
+  return found;
+}
+
+/*
+ * Builtins. These run inside the shell, without a fork or exec,
+ * when the command line is a single command with no pipes or
+ * redirection. Each returns the command's exit status.
+ */
+
+int
+builtin_echo(int argc, char **argv)
+{
+  // build the whole line so that it goes out in one write
+  int len = 0;
+  for (int i = 1; i < argc; i++) {
+    len += strlen(argv[i]) + 1;
+  }
+  if (len == 0) {
+    return 0; // like /echo, print nothing at all
+  }
+  char *line = malloc(len);
+  char *p = line;
+  for (int i = 1; i < argc; i++) {
+    strcpy(p, argv[i]);
+    p += strlen(argv[i]);
+    *p++ = (i + 1 < argc) ? ' ' : '\n';
+  }
+  write(1, line, len);
+  free(line);
+  return 0;
+}
+
+int
+builtin_pwd(int argc, char **argv)
+{
+  if (getcwd(wd, BUFFER_SIZE) < 0) {
+    return 1;
+  }
+  printf("%s\n", wd);
+  return 0;
+}
+
+int
+builtin_true(int argc, char **argv)
+{
+  return 0;
+}
+
+int
+builtin_false(int argc, char **argv)
+{
+  return 1;
+}
+
+// test -e|-f|-d path, test -z|-n str, test a =|!= b,
+// test n -eq|-ne|-lt|-le|-gt|-ge m
+int
+builtin_test(int argc, char **argv)
+{
+  struct stat st;
+
+  if (argc == 3) {
+    char *op = argv[1];
+    if (strcmp(op, "-z") == 0) return strlen(argv[2]) != 0;
+    if (strcmp(op, "-n") == 0) return strlen(argv[2]) == 0;
+    if (stat(argv[2], &st) < 0) return 1;
+    if (strcmp(op, "-e") == 0) return 0;
+    if (strcmp(op, "-f") == 0) return st.type != T_FILE;
+    if (strcmp(op, "-d") == 0) return st.type != T_DIR;
+  } else if (argc == 4) {
+    char *op = argv[2];
+    int a = atoi(argv[1]), b = atoi(argv[3]);
+    if (strcmp(op, "=") == 0) return strcmp(argv[1], argv[3]) != 0;
+    if (strcmp(op, "!=") == 0) return strcmp(argv[1], argv[3]) == 0;
+    if (strcmp(op, "-eq") == 0) return !(a == b);
+    if (strcmp(op, "-ne") == 0) return !(a != b);
+    if (strcmp(op, "-lt") == 0) return !(a < b);
+    if (strcmp(op, "-le") == 0) return !(a <= b);
+    if (strcmp(op, "-gt") == 0) return !(a > b);
+    if (strcmp(op, "-ge") == 0) return !(a >= b);
+  }
+  fprintf(2, "test: bad expression\n");
+  return 2;
+}
+
+int run_builtin(char *buf);
+
+// time command [args]: run the rest of the line and report
+// how long it took and the CPU time it used.
+int
+builtin_time(int argc, char **argv)
+{
+  int len = 0;
+  for (int i = 1; i < argc; i++) {
+    len += strlen(argv[i]) + 1;
+  }
+  if (len == 0) {
+    fprintf(2, "time: no command\n");
+    return 1;
+  }
+  char *line = malloc(len);
+  char *p = line;
+  for (int i = 1; i < argc; i++) {
+    strcpy(p, argv[i]);
+    p += strlen(argv[i]);
+    *p++ = ' ';
+  }
+  p[-1] = '\0';
+
+  exit_status = 0;
+  memset(&last_usage, 0, sizeof(last_usage));
+  uint64 start = nanotime();
+  if (!run_builtin(line)) {
+    run_program(line, 0);
+  }
+  uint64 us = (nanotime() - start) / 1000;
+  printf("real %d.%d%d%dms, user %l ticks, sys %l ticks\n", (int)(us / 1000),
+         (int)(us / 100 % 10), (int)(us / 10 % 10), (int)(us % 10),
+         last_usage.utime, last_usage.stime);
+  free(line);
+  return exit_status;
+}
+
+// jobs: list the background jobs.
+int
+builtin_jobs(int argc, char **argv)
+{
+  reap_jobs();
+  for (int i = 0; i < MAX_JOBS; i++) {
+    struct job *j = &jobs[i];
+    if (j->used && j->background) {
+      printf("[%d] Running %s\n", job_id(j), j->cmd);
+    }
+  }
+  return 0;
+}
+
+// fg [%N]: wait for a background job as if it had been started
+// in the foreground, and take its status.
+int
+builtin_fg(int argc, char **argv)
+{
+  struct job *j = find_job(argc > 1 ? argv[1] : NULL);
+  if (!j) {
+    fprintf(2, "fg: no such job\n");
+    return 1;
+  }
+  printf("%s\n", j->cmd);
+  j->background = false;
+  wait_job(j);
+  last_usage = j->usage;
+  int status = j->statuses[j->n - 1];
+  free_job(j);
+  return status;
+}
+
+// bg [%N]: xv6 has no signals, so a job can't be stopped and
+// every background job is already running. bg only says so.
+int
+builtin_bg(int argc, char **argv)
+{
+  struct job *j = find_job(argc > 1 ? argv[1] : NULL);
+  if (!j) {
+    fprintf(2, "bg: no such job\n");
+    return 1;
+  }
+  printf("[%d] %s &\n", job_id(j), j->cmd);
+  return 0;
+}
+
+// wait [%N]: wait for one background job, or for all of them.
+int
+builtin_wait(int argc, char **argv)
+{
+  int status = 0;
+
+  if (argc > 1) {
+    struct job *j = find_job(argv[1]);
+    if (!j) {
+      fprintf(2, "wait: no such job\n");
+      return 1;
+    }
+    wait_job(j);
+    status = j->statuses[j->n - 1];
+  } else {
+    for (int i = 0; i < MAX_JOBS; i++) {
+      if (jobs[i].used && jobs[i].background) {
+        wait_job(&jobs[i]);
+      }
+    }
+  }
+  reap_jobs();
+  return status;
+}
+
+// parallel [-j N] cmd args ::: cmd args ::: ...
+// Run the commands side by side, at most N at a time (NCPU by
+// default), starting the next as each one exits. Reports the
+// ones that failed; the status is how many did.
+int
+builtin_parallel(int argc, char **argv)
+{
+  struct command cmds[MAX_ARGS];
+  int max = NCPU, first = 1, n = 0;
+
+  if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+    max = atoi(argv[2]);
+    first = 3;
+  }
+  if (max < 1) {
+    fprintf(2, "parallel: bad job count\n");
+    return 1;
+  }
+
+  // cut argv at each ::: so every command is NULL-terminated
+  int start = first;
+  for (int i = first; i <= argc; i++) {
+    if (i < argc && strcmp(argv[i], ":::") != 0) {
+      continue;
+    }
+    argv[i] = NULL;
+    if (i > start) {
+      cmds[n].tokens = &argv[start];
+      cmds[n].token_count = i - start;
+      cmds[n].stdin_file = NULL;
+      cmds[n].stdout_file = NULL;
+      cmds[n].append = false;
+      n++;
+    }
+    start = i + 1;
+  }
+  if (n == 0) {
+    fprintf(2, "parallel: no commands\n");
+    return 1;
+  }
+
+  struct job *j = alloc_job("parallel", n, false);
+  if (!j) {
+    fprintf(2, "parallel: too many jobs\n");
+    return 1;
+  }
+  for (int next = 0; next < n || j->left > 0; ) {
+    if (next < n && j->left < max) {
+      j->pids[next] = spawn_stage(&cmds[next], -1, -1, -1);
+      j->left++;
+      next++;
+    } else if (reap_one(0) < 0) {
+      break;
+    }
+  }
+
+  int failed = 0;
+  for (int i = 0; i < n; i++) {
+    if (j->statuses[i] != 0) {
+      fprintf(2, "parallel: %s exited with status %d\n", cmds[i].tokens[0],
+              j->statuses[i]);
+      failed++;
+    }
+  }
+  last_usage = j->usage;
+  free_job(j);
+  return failed;
+}
+
+struct builtin {
+  char *name;
+  int (*fn)(int argc, char **argv);
+};
+
+struct builtin builtins[] = {
+  { "echo",  builtin_echo },
+  { "pwd",   builtin_pwd },
+  { "true",  builtin_true },
+  { "false", builtin_false },
+  { "test",  builtin_test },
+  { "time",  builtin_time },
+  { "jobs",  builtin_jobs },
+  { "fg",    builtin_fg },
+  { "bg",    builtin_bg },
+  { "wait",  builtin_wait },
+  { "parallel", builtin_parallel },
+};
+
+// Run buf in the shell if it is a builtin that needs no process
+// of its own. Returns 1 if it ran (setting exit_status), 0 if
+// the caller should run it as a program.
+int
+run_builtin(char *buf)
+{
+  if (strchr(buf, '|') || strchr(buf, '<') || strchr(buf, '>')) {
+    return 0;
+  }
+
+  char *line = malloc(strlen(buf) + 1);
+  char *s = line;
+  char *argv[MAX_ARGS];
+  int argc = 0;
+
+  strcpy(line, buf);
+  while (argc < MAX_ARGS - 1 && (argv[argc] = next_token(&s, " "))) {
+    argc++;
+  }
+  argv[argc] = NULL;
+
+  if (argc > 0 && argv[0][0] == '%') { // %N is short for fg %N
+    char *fg[] = { "fg", argv[0], NULL };
+    exit_status = builtin_fg(2, fg);
+    free(line);
+    return 1;
+  }
+  if (argc > 0) {
+    for (int i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+      if (strcmp(argv[0], builtins[i].name) == 0) {
+        exit_status = builtins[i].fn(argc, argv);
+        free(line);
+        return 1;
+      }
+    }
+  }
+  free(line);
+  return 0;
 }
 
 void
 run_program(char* buf, int background)
 {
-  int pid = pork("failed to fork child process in run_program");
-  
-  if(pid == 0) {
-    parse_and_run_cmd(buf);
-  } else if(pid > 0) {
-    if (background) {
-      printf("Running job in background, pid = %d\n", pid);
-    } else {
-      int status;
-      while (wait(&status) != pid) { /* do nothing */}
-      exit_status = status;
+  if (!background && run_builtin(buf)) {
+    return;
+  }
+
+  // the stages' tokens point into line, so buf stays intact for history.
+  char *line = malloc(strlen(buf) + 1);
+  strcpy(line, buf);
+
+  int n;
+  struct command *cmds = parse_cmds(line, &n);
+  struct job *j = NULL;
+  if (n > 0 && (j = alloc_job(buf, n, background)) == NULL) {
+    boog_error("too many jobs");
+  }
+
+  // the shell starts every stage itself, so an n-stage
+  // pipeline costs n forks and the shell waits on each.
+  int in = -1; // read end of the pipe from the previous stage
+  for (int i = 0; j && i < n; i++) {
+    int fd[2] = { -1, -1 };
+    if (i + 1 < n && pipe(fd) < 0) {
+      boog_error("failed to create pipe");
+      j->n = i;
+      break;
+    }
+    j->pids[i] = spawn_stage(&cmds[i], in, fd[1], fd[0]);
+    j->left++;
+    if (in != -1) {
+      close(in);
     }
+    if (fd[1] != -1) {
+      close(fd[1]);
+    }
+    in = fd[0];
+  }
+  if (in != -1) { // a pipe failed after the stage feeding it started
+    close(in);
+  }
+
+  if (j && j->n == 0) {
+    free_job(j);
+  } else if (j && background) {
+    printf("[%d] Running job in background, pid = %d\n", job_id(j),
+           j->pids[j->n - 1]);
+  } else if (j) {
+    // wait for every stage; the pipeline's status is the last one's.
+    // background jobs that exit meanwhile are credited to their job.
+    wait_job(j);
+    last_usage = j->usage;
+    exit_status = j->statuses[j->n - 1];
+    for (int i = 0; j->n > 1 && i < j->n; i++) {
+      if (j->statuses[i] != 0) {
+        fprintf(2, "stage %d (%s) exited with status %d\n", i + 1,
+                cmds[i].tokens[0] ? cmds[i].tokens[0] : "?", j->statuses[i]);
+      }
+    }
+    free_job(j);
+  }
+
+  for (int i = 0; i < n; i++) {
+    free(cmds[i].tokens);
   }
+  free(cmds);
+  free(line);
 }
 
 void
@@ -582,7 +1253,8 @@ choose_cmd(char *buf, struct history *h)
     buf[len - 1] = '\0';
   }
   
-  int t_start = unixtime();
+  memset(&last_usage, 0, sizeof(last_usage));
+  uint64 t_start = nanotime();
   switch (choice) {
     case CD:
       change_directory(buf);
@@ -609,7 +1281,7 @@ choose_cmd(char *buf, struct history *h)
       enter_the_matrix();
       break;
   }
-  int t_end = unixtime();
+  uint64 t_end = nanotime();
   return (t_end - t_start) / 1000000;
 }
 
@@ -642,11 +1314,12 @@ main(int argc, char **argv)
 {
   // variables
   char buf[BUFFER_SIZE];
-  struct history h;
-  init_history(&h);
+  struct history *h = &history;
+  init_history(h);
 
   // scripting variables + global scripting bool
   int fd = 0;
+  struct stream *script = NULL; // buffered, so lines don't cost a read() per byte
   
   char *line = NULL;
   uint max = 0;
@@ -657,29 +1330,36 @@ main(int argc, char **argv)
       boog_error("scripting file doesn't exist");
       exit(1);
     }
+    if ((script = sopen(fd)) == NULL) {
+      panic("failed to allocate script stream");
+    }
     scripting = true;
   }
 
   print_welcome();
+  if (!scripting) { // scripts neither see nor add to the saved history
+    load_history(h);
+  }
 
   bool read_first_script_line = false;
   
   while(true) {
+    reap_jobs();
     if (!scripting) {
       prompt();
       getcmd(buf, sizeof(buf));
       check_comment(buf);
       exit_status = 0; // reset exit status
       cmd_num++;
-      int time_taken = choose_cmd(buf, &h);
+      int time_taken = choose_cmd(buf, h);
       if (time_taken == -1) continue;
       if (exit_status == 0) {
-        add_history(&h, buf, time_taken);
+        add_history(h, buf, time_taken, &last_usage);
       }
       continue;
     }
 
-    if (getline(&line, &max, fd) <= 0) {
+    if (sgetline(&line, &max, script) <= 0) {
       break;
     }
 
@@ -694,10 +1374,10 @@ main(int argc, char **argv)
     strcpy(buf, line);
     check_comment(buf);
     exit_status =  0;
-    int time_taken = choose_cmd(buf, &h);
+    int time_taken = choose_cmd(buf, h);
     if (time_taken == -1) continue;
     if (exit_status == 0) {
-      add_history(&h, buf, time_taken);
+      add_history(h, buf, time_taken, &last_usage);
     }
   }
 
@@ -0,0 +1,103 @@
+#include "../kernel/types.h"
+#include "../kernel/fcntl.h"
+#include "../kernel/kstat.h"
+#include "user.h"
+
+// Disk queue benchmark. Runs 1, 2, 4 and 8 concurrent writers,
+// each writing its own file through the log, and reports the
+// throughput next to how deep the virtio queue got and how many
+// requests carried more than one block.
+//
+// usage: diskbench [kb-per-writer]
+
+#define MAXWRITERS 8
+
+char buf[4096];
+
+void
+diskbench_error(char *err)
+{
+  printf("diskbench error: %s\n", err);
+}
+
+void
+writer(int id, int kb)
+{
+  char name[] = "dbench0";
+  name[6] = '0' + id;
+
+  int fd = open(name, O_CREATE | O_WRONLY | O_TRUNC);
+  if (fd < 0) {
+    diskbench_error("open failed");
+    exit(1);
+  }
+  for (int i = 0; i < kb / 4; i++) {
+    if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      diskbench_error("write failed");
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink(name);
+  exit(0);
+}
+
+void
+run(int nwriters, int kb)
+{
+  struct diskstat before, after;
+
+  kstat(KSTAT_DISK, &before, sizeof(before));
+  uint64 start = nanotime();
+
+  for (int i = 0; i < nwriters; i++) {
+    int pid = fork();
+    if (pid < 0) {
+      diskbench_error("fork failed");
+      exit(1);
+    } else if (pid == 0) {
+      writer(i, kb);
+    }
+  }
+  for (int i = 0; i < nwriters; i++) {
+    wait(0);
+  }
+
+  uint64 ms = (nanotime() - start) / 1000000;
+  kstat(KSTAT_DISK, &after, sizeof(after));
+
+  uint64 reqs = after.requests - before.requests;
+  uint64 blocks = after.blocks - before.blocks;
+  uint64 merged = after.merged - before.merged;
+  uint64 depth10 = reqs ? (after.depthsum - before.depthsum) * 10 / reqs : 0;
+  uint64 kbps = ms ? (uint64)nwriters * kb * 1000 / ms : 0;
+
+  printf("%d writers: %l KB in %l ms, %l KB/s, %l requests (%l merged), "
+         "%l blocks, avg depth %l.%l\n",
+         nwriters, (uint64)nwriters * kb, ms, kbps, reqs, merged,
+         blocks, depth10 / 10, depth10 % 10);
+}
+
+int
+main(int argc, char **argv)
+{
+  int kb = 32;
+
+  if (argc > 1) {
+    kb = atoi(argv[1]);
+  }
+  if (kb < 4) {
+    diskbench_error("need at least 4 KB per writer");
+    exit(1);
+  }
+  memset(buf, 'd', sizeof(buf));
+
+  for (int n = 1; n <= MAXWRITERS; n *= 2) {
+    run(n, kb);
+  }
+
+  struct diskstat st;
+  kstat(KSTAT_DISK, &st, sizeof(st));
+  printf("max queue depth since boot: %l\n", st.maxdepth);
+  exit(0);
+}
@@ -11,6 +11,37 @@
 
 char *argv[] = { "sh", 0 };
 
+// A benchmark image (make bench-report) has an autorun script.
+// Run it instead of a shell, bracketed by lines the host looks
+// for in the console output, and power off when it's done.
+void
+autorun(void)
+{
+  char *rargv[] = { "autorun", 0 };
+  int fd, pid, status = -1;
+
+  if((fd = open("autorun", O_RDONLY)) < 0)
+    return;
+  close(fd);
+
+  printf("autorun: start\n");
+  pid = fork();
+  if(pid < 0){
+    printf("init: fork failed\n");
+  } else if(pid == 0){
+    exec("autorun", rargv);
+    printf("init: exec autorun failed\n");
+    exit(1);
+  } else {
+    // reap orphans too, until the script itself exits.
+    while(wait(&status) != pid)
+      ;
+  }
+  printf("autorun: exit %d\n", status);
+  sleep(5);  // the UART sends output asynchronously; let it drain.
+  shutdown();
+}
+
 int
 main(void)
 {
@@ -23,6 +54,8 @@ main(void)
   dup(0);  // stdout
   dup(0);  // stderr
 
+  autorun();
+
   for(;;){
     printf("init: starting sh\n");
     pid = fork();
@@ -0,0 +1,172 @@
+#include "../kernel/types.h"
+#include "../kernel/kstat.h"
+#include "user.h"
+
+// Print kernel subsystem statistics.
+// usage: kstat [kmem] [bcache] [disk] [ra] [log] [vm] [sched]
+
+void
+kstat_error(char *err)
+{
+  printf("kstat error: %s\n", err);
+}
+
+void
+print_kmem()
+{
+  struct kmemstat st;
+
+  if (kstat(KSTAT_KMEM, &st, sizeof(st)) != sizeof(st)) {
+    kstat_error("kmem stats unavailable");
+    return;
+  }
+  printf("kmem:\n");
+  printf("  free pages:   %l (%l in shared pool)\n", st.nfree, st.nshared);
+  printf("  allocs:       %l\n", st.allocs);
+  printf("  frees:        %l\n", st.frees);
+  printf("  refills:      %l\n", st.refills);
+  printf("  drains:       %l\n", st.drains);
+  printf("  steals:       %l\n", st.steals);
+  printf("  contended:    %l\n", st.contended);
+  printf("  cow shared:   %l pages\n", st.cowpages);
+}
+
+void
+print_bcache()
+{
+  struct bcachestat st;
+
+  if (kstat(KSTAT_BCACHE, &st, sizeof(st)) != sizeof(st)) {
+    kstat_error("bcache stats unavailable");
+    return;
+  }
+  printf("bcache:\n");
+  printf("  buffers:      %l in %l buckets\n", st.nbuf, st.nbucket);
+  printf("  hits:         %l\n", st.hits);
+  printf("  misses:       %l\n", st.misses);
+  printf("  evictions:    %l\n", st.evictions);
+}
+
+void
+print_disk()
+{
+  struct diskstat st;
+
+  if (kstat(KSTAT_DISK, &st, sizeof(st)) != sizeof(st)) {
+    kstat_error("disk stats unavailable");
+    return;
+  }
+  printf("disk:\n");
+  printf("  requests:     %l (%l reads, %l writes)\n", st.requests, st.reads, st.writes);
+  printf("  blocks:       %l\n", st.blocks);
+  printf("  merged:       %l\n", st.merged);
+  printf("  max depth:    %l\n", st.maxdepth);
+  printf("  in flight:    %l\n", st.inflight);
+}
+
+void
+print_ra()
+{
+  struct rastat st;
+
+  if (kstat(KSTAT_RA, &st, sizeof(st)) != sizeof(st)) {
+    kstat_error("read-ahead stats unavailable");
+    return;
+  }
+  printf("read-ahead:\n");
+  printf("  prefetched:   %l\n", st.issued);
+  printf("  hits:         %l (%l still in flight)\n", st.hits, st.late);
+  printf("  wasted:       %l\n", st.wasted);
+  printf("  sync reads:   %l\n", st.misses);
+}
+
+void
+print_log()
+{
+  struct logstat st;
+
+  if (kstat(KSTAT_LOG, &st, sizeof(st)) != sizeof(st)) {
+    kstat_error("log stats unavailable");
+    return;
+  }
+  printf("log:\n");
+  printf("  commits:      %l\n", st.commits);
+  printf("  blocks:       %l\n", st.blocks);
+  printf("  ops:          %l (max %l per commit)\n", st.ops, st.maxops);
+  if (st.commits > 0) {
+    printf("  avg batch:    %l ops, %l blocks\n", st.ops / st.commits, st.blocks / st.commits);
+    // the time CSR counts at 10 MHz in qemu.
+    printf("  avg latency:  %l us (max %l)\n", st.time / st.commits / 10, st.maxtime / 10);
+  }
+  printf("  space waits:  %l\n", st.waits);
+}
+
+void
+print_vm()
+{
+  struct vmstat st;
+
+  if (kstat(KSTAT_VM, &st, sizeof(st)) != sizeof(st)) {
+    kstat_error("vm stats unavailable");
+    return;
+  }
+  printf("vm:\n");
+  printf("  cow copies:   %l (%l reused)\n", st.cowcopies, st.cowreuses);
+  printf("  sbrk pages:   %l reserved, %l faulted in\n", st.lazyreserved, st.lazyfaulted);
+  printf("  exec pages:   %l faulted in, %l shared from cache\n", st.execfaults, st.exechits);
+}
+
+void
+print_sched()
+{
+  struct schedstat st;
+
+  if (kstat(KSTAT_SCHED, &st, sizeof(st)) != sizeof(st)) {
+    kstat_error("sched stats unavailable");
+    return;
+  }
+  printf("sched:\n");
+  printf("  switches:     %l (%l stolen)\n", st.switches, st.steals);
+  printf("  idle waits:   %l\n", st.idles);
+  printf("  boosts:       %l\n", st.boosts);
+  printf("  runnable:     %l\n", st.runnable);
+  printf("  sleeping:     %l\n", st.sleepers);
+  printf("  wakeups:      %l (%l sleepers examined)\n", st.wakeups, st.wakescans);
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc < 2) {
+    print_kmem();
+    print_bcache();
+    print_disk();
+    print_ra();
+    print_log();
+    print_vm();
+    print_sched();
+    exit(0);
+  }
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "kmem") == 0) {
+      print_kmem();
+    } else if (strcmp(argv[i], "bcache") == 0) {
+      print_bcache();
+    } else if (strcmp(argv[i], "disk") == 0) {
+      print_disk();
+    } else if (strcmp(argv[i], "ra") == 0) {
+      print_ra();
+    } else if (strcmp(argv[i], "log") == 0) {
+      print_log();
+    } else if (strcmp(argv[i], "vm") == 0) {
+      print_vm();
+    } else if (strcmp(argv[i], "sched") == 0) {
+      print_sched();
+    } else {
+      kstat_error(argv[i]);
+      exit(1);
+    }
+  }
+  exit(0);
+}
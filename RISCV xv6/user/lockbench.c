@@ -0,0 +1,101 @@
+#include "../kernel/types.h"
+#include "../kernel/param.h"
+#include "../kernel/kstat.h"
+#include "../kernel/syscall.h"
+#include "../kernel/sysstat.h"
+#include "user.h"
+
+// Spinlock microbenchmark. 1 to NCPU processes call uptime(),
+// which does little more than take tickslock, as fast as they
+// can. For each number of processes it reports the throughput,
+// the median and 99th percentile uptime() latency, and how often
+// tickslock was contended. Build the kernel with and without
+// TICKETLOCK=1, and boot with CPUS=1..8, to compare locks.
+// usage: lockbench [calls per process]
+
+struct sysstat st;
+struct lockstat before[NLOCKCLASS];
+struct lockstat after[NLOCKCLASS];
+
+void
+lockbench_error(char *err)
+{
+  printf("lockbench error: %s\n", err);
+}
+
+// The statistics for the lock class called name.
+struct lockstat*
+find_lock(struct lockstat *ls, char *name)
+{
+  int n = kstat(KSTAT_LOCK, ls, NLOCKCLASS * sizeof(struct lockstat));
+
+  for (int i = 0; i < n / (int)sizeof(struct lockstat); i++) {
+    if (strcmp(ls[i].name, name) == 0) {
+      return &ls[i];
+    }
+  }
+  lockbench_error("no tickslock statistics");
+  exit(1);
+}
+
+void
+run(int nprocs, int calls)
+{
+  benchmark_reset();
+  struct lockstat *lb = find_lock(before, "time");
+  uint64 start = nanotime();
+
+  for (int i = 0; i < nprocs; i++) {
+    int pid = fork();
+    if (pid < 0) {
+      lockbench_error("fork failed");
+      exit(1);
+    } else if (pid == 0) {
+      for (int j = 0; j < calls; j++) {
+        uptime();
+      }
+      exit(0);
+    }
+  }
+  for (int i = 0; i < nprocs; i++) {
+    wait(0);
+  }
+
+  uint64 us = (nanotime() - start) / 1000;
+  struct lockstat *la = find_lock(after, "time");
+  if (sysstat(SYSSTAT_CHILDREN, &st) < 0) {
+    lockbench_error("sysstat failed");
+    exit(1);
+  }
+
+  uint64 n = st.count[SYS_uptime];
+  uint64 acquires = la->acquires - lb->acquires;
+  uint64 contended = la->contended - lb->contended;
+  print_column(nprocs, 5);
+  print_column(us ? n * 1000 / us : 0, 10);
+  print_column(percentile(st.hist[SYS_uptime], n, 50), 10);
+  print_column(percentile(st.hist[SYS_uptime], n, 99), 10);
+  print_column(acquires ? contended * 100 / acquires : 0, 10);
+  print_column(la->spins - lb->spins, 12);
+  printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+  int calls = 20000;
+
+  if (argc > 1) {
+    calls = atoi(argv[1]);
+  }
+  if (calls <= 0) {
+    lockbench_error("invalid args");
+    exit(1);
+  }
+
+  printf(" procs   calls/ms       p50<       p99< %%contended        spins\n");
+  for (int n = 1; n <= NCPU; n++) {
+    run(n, calls);
+  }
+  exit(0);
+}
@@ -0,0 +1,105 @@
+#include "../kernel/types.h"
+#include "../kernel/param.h"
+#include "../kernel/kstat.h"
+#include "user.h"
+
+// Print spinlock statistics, one line per lock name, busiest
+// first. With a command, only the activity while it ran is shown.
+// Hold times are in cycles.
+// usage: lockstat [command args...]
+
+struct lockstat before[NLOCKCLASS];
+struct lockstat after[NLOCKCLASS];
+
+void
+lockstat_error(char *err)
+{
+  printf("lockstat error: %s\n", err);
+}
+
+int
+read_locks(struct lockstat *st)
+{
+  int n = kstat(KSTAT_LOCK, st, NLOCKCLASS * sizeof(struct lockstat));
+
+  if (n < 0) {
+    lockstat_error("lock stats unavailable");
+    exit(1);
+  }
+  return n / sizeof(struct lockstat);
+}
+
+// a is busier than b: more spinning, then more acquires.
+int
+busier(struct lockstat *a, struct lockstat *b)
+{
+  if (a->spins != b->spins) {
+    return a->spins > b->spins;
+  }
+  return a->acquires > b->acquires;
+}
+
+void
+print_locks(struct lockstat *st, int n)
+{
+  int order[NLOCKCLASS];
+
+  for (int i = 0; i < n; i++) {
+    int j;
+    for (j = i; j > 0 && busier(&st[i], &st[order[j - 1]]); j--) {
+      order[j] = order[j - 1];
+    }
+    order[j] = i;
+  }
+
+  printf("lock             acquires  contended      spins   avg hold   max hold\n");
+  for (int k = 0; k < n; k++) {
+    struct lockstat *s = &st[order[k]];
+    if (s->acquires == 0) {
+      continue;
+    }
+    printf("%s", s->name);
+    for (int len = strlen(s->name); len < 14; len++) {
+      printf(" ");
+    }
+    print_column(s->acquires, 10);
+    print_column(s->contended, 10);
+    print_column(s->spins, 10);
+    print_column(s->holdtime / s->acquires, 10);
+    print_column(s->maxhold, 10);
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc < 2) {
+    print_locks(after, read_locks(after));
+    exit(0);
+  }
+
+  int nbefore = read_locks(before);
+  int pid = fork();
+  if (pid < 0) {
+    lockstat_error("fork failed");
+    exit(1);
+  } else if (pid == 0) {
+    exec(argv[1], &argv[1]);
+    lockstat_error("exec failed");
+    exit(1);
+  }
+  wait(0);
+  int n = read_locks(after);
+
+  // lock classes are only ever added, so before[i]
+  // and after[i] are the same class.
+  for (int i = 0; i < nbefore; i++) {
+    after[i].acquires -= before[i].acquires;
+    after[i].contended -= before[i].contended;
+    after[i].spins -= before[i].spins;
+    after[i].holdtime -= before[i].holdtime;
+  }
+  print_locks(after, n);
+  exit(0);
+}
@@ -0,0 +1,86 @@
+#include "../kernel/types.h"
+#include "user.h"
+
+// Pipe throughput benchmark. A child writes the same amount of
+// data into a pipe using several write sizes while the parent
+// reads it back, and the throughput of each size is reported.
+//
+// usage: pipebench [kb]
+
+char buf[16384];
+
+int sizes[] = { 1, 64, 512, 4096, 16384 };
+
+void
+pipebench_error(char *err)
+{
+  printf("pipebench error: %s\n", err);
+}
+
+void
+run(int size, int kb)
+{
+  int fds[2];
+  uint64 total = (uint64)kb * 1024;
+  uint64 got = 0;
+
+  if (pipe(fds) < 0) {
+    pipebench_error("pipe failed");
+    exit(1);
+  }
+
+  uint64 start = nanotime();
+  int pid = fork();
+  if (pid < 0) {
+    pipebench_error("fork failed");
+    exit(1);
+  } else if (pid == 0) {
+    close(fds[0]);
+    for (uint64 sent = 0; sent < total; sent += size) {
+      if (write(fds[1], buf, size) != size) {
+        pipebench_error("write failed");
+        exit(1);
+      }
+    }
+    close(fds[1]);
+    exit(0);
+  }
+
+  close(fds[1]);
+  int n;
+  while ((n = read(fds[0], buf, size)) > 0) {
+    got += n;
+  }
+  close(fds[0]);
+  wait(0);
+
+  uint64 ms = (nanotime() - start) / 1000000;
+  uint64 kbps = ms ? got * 1000 / 1024 / ms : 0;
+
+  if (got != total) {
+    pipebench_error("short read");
+  }
+  printf("%d byte writes: %l KB in %l ms, %l KB/s\n", size, got / 1024, ms, kbps);
+}
+
+int
+main(int argc, char **argv)
+{
+  int kb = 1024;
+
+  if (argc > 1) {
+    kb = atoi(argv[1]);
+  }
+  if (kb < 16) {
+    pipebench_error("need at least 16 KB");
+    exit(1);
+  }
+  kb -= kb % 16;  // whole 16 KB writes
+  memset(buf, 'p', sizeof(buf));
+
+  for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    // byte-at-a-time writes are slow; keep that run short.
+    run(sizes[i], sizes[i] == 1 ? kb / 16 : kb);
+  }
+  exit(0);
+}
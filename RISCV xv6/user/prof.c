@@ -0,0 +1,258 @@
+#include "../kernel/types.h"
+#include "../kernel/stat.h"
+#include "../kernel/param.h"
+#include "../kernel/prof.h"
+#include "user.h"
+
+// Sampling profiler. Runs a command with the kernel's profiler
+// on, then prints the functions, in the kernel or in user
+// programs, where the timer interrupt found the CPUs most often.
+// Addresses are looked up in the *.sym files on the file system.
+// usage: prof command [args...]
+
+#define MAXSAMPLES (NCPU * NPROFSAMPLE)
+#define MAXTABLES  16
+#define TOP        20
+
+struct sym {
+  uint64 addr;
+  char *name;
+};
+
+// symbols of one program, sorted by address.
+struct symtab {
+  char file[24];
+  struct sym *syms;
+  int nsyms;
+  int *hits;         // samples per symbol
+  int unknown;       // samples not in any symbol
+};
+
+struct profsample samples[MAXSAMPLES];
+struct symtab tables[MAXTABLES];
+int ntables;
+
+void
+prof_error(char *err)
+{
+  printf("prof error: %s\n", err);
+}
+
+uint64
+parse_hex(char *s, char **end)
+{
+  uint64 v = 0;
+
+  for (;; s++) {
+    if (*s >= '0' && *s <= '9') {
+      v = v * 16 + *s - '0';
+    } else if (*s >= 'a' && *s <= 'f') {
+      v = v * 16 + *s - 'a' + 10;
+    } else {
+      break;
+    }
+  }
+  *end = s;
+  return v;
+}
+
+// Read a symbol file of "address name" lines. Names with a dot
+// in them are source files and sections, not functions.
+void
+load_symtab(struct symtab *t)
+{
+  struct stat st;
+  char *buf, *p, *line;
+  int fd, n;
+
+  t->syms = 0;
+  t->nsyms = 0;
+  if ((fd = open(t->file, 0)) < 0) {
+    return;
+  }
+  if (fstat(fd, &st) < 0 || (buf = malloc(st.size + 1)) == 0) {
+    close(fd);
+    return;
+  }
+  n = read(fd, buf, st.size);
+  close(fd);
+  if (n < 0) {
+    free(buf);
+    return;
+  }
+  buf[n] = 0;
+
+  int lines = 0;
+  for (p = buf; *p; p++) {
+    if (*p == '\n') {
+      lines++;
+    }
+  }
+  t->syms = malloc((lines + 1) * sizeof(struct sym));
+
+  for (line = buf; *line; line = p) {
+    char *name;
+    uint64 addr = parse_hex(line, &name);
+    for (p = name; *p && *p != '\n'; p++)
+      ;
+    if (*p) {
+      *p++ = 0;
+    }
+    if (*name == ' ') {
+      name++;
+    }
+    if (*name == 0 || strchr(name, '.')) {
+      continue;
+    }
+    t->syms[t->nsyms].addr = addr;
+    t->syms[t->nsyms].name = name;
+    t->nsyms++;
+  }
+
+  // shell sort by address.
+  for (int gap = t->nsyms / 2; gap > 0; gap /= 2) {
+    for (int i = gap; i < t->nsyms; i++) {
+      struct sym s = t->syms[i];
+      int j;
+      for (j = i; j >= gap && t->syms[j - gap].addr > s.addr; j -= gap) {
+        t->syms[j] = t->syms[j - gap];
+      }
+      t->syms[j] = s;
+    }
+  }
+
+  t->hits = malloc((t->nsyms + 1) * sizeof(int));
+  memset(t->hits, 0, (t->nsyms + 1) * sizeof(int));
+}
+
+// The symbol table for user program name, or for the kernel.
+struct symtab*
+find_symtab(char *name, int user)
+{
+  char file[24];
+  int n;
+
+  if (user) {
+    n = strlen(name);
+    if (n > sizeof(file) - 5) {
+      n = sizeof(file) - 5;
+    }
+    memmove(file, name, n);
+    strcpy(file + n, ".sym");
+  } else {
+    strcpy(file, "kernel.sym");
+  }
+
+  for (int i = 0; i < ntables; i++) {
+    if (strcmp(tables[i].file, file) == 0) {
+      return &tables[i];
+    }
+  }
+  if (ntables == MAXTABLES) {
+    return 0;
+  }
+  struct symtab *t = &tables[ntables++];
+  strcpy(t->file, file);
+  load_symtab(t);
+  return t;
+}
+
+// Count a sample at pc against the last symbol at or below it.
+void
+count(struct symtab *t, uint64 pc)
+{
+  int lo = 0, hi = t->nsyms - 1, found = -1;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (t->syms[mid].addr <= pc) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  if (found < 0) {
+    t->unknown++;
+  } else {
+    t->hits[found]++;
+  }
+}
+
+void
+print_top(int total)
+{
+  for (int k = 0; k < TOP; k++) {
+    struct symtab *best = 0;
+    int besti = 0, most = 0;
+
+    for (int i = 0; i < ntables; i++) {
+      for (int j = 0; j < tables[i].nsyms; j++) {
+        if (tables[i].hits[j] > most) {
+          most = tables[i].hits[j];
+          best = &tables[i];
+          besti = j;
+        }
+      }
+    }
+    if (best == 0) {
+      break;
+    }
+    printf("%d\t%d%%\t%s %s\n", most, most * 100 / total, best->file,
+           best->syms[besti].name);
+    best->hits[besti] = 0;
+  }
+  for (int i = 0; i < ntables; i++) {
+    if (tables[i].unknown) {
+      printf("%d\t%d%%\t%s ?\n", tables[i].unknown,
+             tables[i].unknown * 100 / total, tables[i].file);
+    }
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc < 2) {
+    prof_error("invalid args");
+    exit(1);
+  }
+
+  if (prof(PROF_START, 0, 0) < 0) {
+    prof_error("cannot start profiler");
+    exit(1);
+  }
+
+  int pid = fork();
+  if (pid < 0) {
+    prof_error("fork failed");
+    exit(1);
+  } else if (pid == 0) {
+    exec(argv[1], &argv[1]);
+    prof_error("exec failed");
+    exit(1);
+  }
+  wait(0);
+
+  int lost = prof(PROF_STOP, 0, 0);
+  int n = prof(PROF_DRAIN, samples, MAXSAMPLES);
+  if (n <= 0) {
+    prof_error("no samples");
+    exit(1);
+  }
+
+  for (int i = 0; i < n; i++) {
+    struct symtab *t = find_symtab(samples[i].name, samples[i].user);
+    if (t) {
+      count(t, samples[i].pc);
+    }
+  }
+
+  printf("%d samples", n);
+  if (lost > 0) {
+    printf(", %d lost", lost);
+  }
+  printf("\nsamples\tpct\twhere\n");
+  print_top(n);
+  exit(0);
+}
@@ -0,0 +1,37 @@
+#include "../kernel/types.h"
+#include "../kernel/sysstat.h"
+#include "user.h"
+
+// Output helpers shared by the tools that report on the
+// kernel's statistics (benchmark, lockstat, lockbench, ...).
+
+// Print v right-aligned in a field of the given width.
+void
+print_column(uint64 v, int width)
+{
+  int digits = 1;
+
+  for (uint64 x = v; x >= 10; x /= 10) {
+    digits++;
+  }
+  for (; digits < width; digits++) {
+    printf(" ");
+  }
+  printf(" %l", v);
+}
+
+// Upper bound, in cycles, of the sysstat histogram bucket
+// holding the given fraction (in percent) of the calls.
+uint64
+percentile(uint *hist, uint64 count, int pct)
+{
+  uint64 seen = 0;
+
+  for (int b = 0; b < NSYSHIST; b++) {
+    seen += hist[b];
+    if (seen * 100 >= count * pct) {
+      return 1L << (b + SYSHISTSHIFT + 1);
+    }
+  }
+  return 1L << (NSYSHIST + SYSHISTSHIFT);
+}
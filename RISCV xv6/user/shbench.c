@@ -0,0 +1,94 @@
+#include "../kernel/types.h"
+#include "../kernel/fcntl.h"
+#include "user.h"
+
+// Script throughput benchmark. Writes boogsh scripts of echo
+// lines and times boogsh running them, once with the echo
+// builtin and once with /echo, which names the program on disk
+// and so is forked and exec'd the old way.
+// usage: shbench [lines]
+
+#define SCRIPT "sbench.sh"
+#define OUTPUT "sbench.out"
+
+char line[64];
+
+void
+shbench_error(char *err)
+{
+  fprintf(2, "shbench error: %s\n", err);
+  exit(1);
+}
+
+void
+write_script(char *echo, int lines)
+{
+  int fd = open(SCRIPT, O_CREATE | O_TRUNC | O_WRONLY);
+  if (fd < 0) {
+    shbench_error("cannot create " SCRIPT);
+  }
+  write(fd, "#!boogsh\n", 9);
+  for (int i = 0; i < lines; i++) {
+    strcpy(line, echo);
+    strcpy(line + strlen(line), " Command ");
+    int n = strlen(line);
+    line[n++] = '0' + i / 100 % 10;
+    line[n++] = '0' + i / 10 % 10;
+    line[n++] = '0' + i % 10;
+    line[n++] = '\n';
+    write(fd, line, n);
+  }
+  close(fd);
+}
+
+// Run boogsh on the script with its output going to a file.
+// Returns the time taken in ns.
+uint64
+run_script()
+{
+  char *argv[] = { "boogsh", SCRIPT, 0 };
+  uint64 start = nanotime();
+
+  int pid = fork();
+  if (pid < 0) {
+    shbench_error("fork failed");
+  } else if (pid == 0) {
+    close(1);
+    if (open(OUTPUT, O_CREATE | O_TRUNC | O_WRONLY) != 1) {
+      shbench_error("cannot create " OUTPUT);
+    }
+    exec(argv[0], argv);
+    shbench_error("exec boogsh failed");
+  }
+  wait(0);
+  return nanotime() - start;
+}
+
+void
+run(char *echo, int lines)
+{
+  write_script(echo, lines);
+  uint64 ns = run_script();
+  uint64 us = ns / 1000;
+  printf("%s\t%d lines\t%d ms\t%d lines/s\n", echo, lines, (int)(us / 1000),
+         us ? (int)((uint64)lines * 1000000 / us) : 0);
+}
+
+int
+main(int argc, char **argv)
+{
+  int lines = 200;
+
+  if (argc > 1) {
+    lines = atoi(argv[1]);
+  }
+  if (lines <= 0) {
+    shbench_error("invalid args");
+  }
+
+  run("/echo", lines);
+  run("echo", lines);
+  unlink(SCRIPT);
+  unlink(OUTPUT);
+  exit(0);
+}
@@ -0,0 +1,128 @@
+#include "../kernel/types.h"
+#include "../kernel/param.h"
+#include "../kernel/kstat.h"
+#include "user.h"
+
+// Sleep/wakeup benchmark. Parks a number of idle processes asleep
+// on a pipe, then times pipe round trips between two other
+// processes, each of which takes a wakeup(). Reports the round
+// trip time and how many sleeping processes each wakeup() had to
+// look at, which should stay flat however many are parked.
+// usage: sleepbench [round trips]
+
+int counts[] = { 0, 8, 16, 32, NPROC - 8 };
+
+void
+sleepbench_error(char *err)
+{
+  printf("sleepbench error: %s\n", err);
+}
+
+void
+read_sched(struct schedstat *st)
+{
+  if (kstat(KSTAT_SCHED, st, sizeof(*st)) != sizeof(*st)) {
+    sleepbench_error("sched stats unavailable");
+    exit(1);
+  }
+}
+
+// Fork n processes that sleep reading gate until it is closed.
+void
+park(int n, int *gate)
+{
+  char c;
+
+  for (int i = 0; i < n; i++) {
+    int pid = fork();
+    if (pid < 0) {
+      sleepbench_error("fork failed");
+      exit(1);
+    } else if (pid == 0) {
+      close(gate[1]);
+      read(gate[0], &c, 1);
+      exit(0);
+    }
+  }
+}
+
+void
+run(int nsleepers, int trips)
+{
+  int gate[2], ping[2], pong[2];
+  struct schedstat before, after;
+  char c = 0;
+
+  if (pipe(gate) < 0) {
+    sleepbench_error("pipe failed");
+    exit(1);
+  }
+  park(nsleepers, gate);
+  close(gate[0]);
+
+  if (pipe(ping) < 0 || pipe(pong) < 0) {
+    sleepbench_error("pipe failed");
+    exit(1);
+  }
+  int pid = fork();
+  if (pid < 0) {
+    sleepbench_error("fork failed");
+    exit(1);
+  } else if (pid == 0) {
+    // keep only the ends it uses, so that ping sees EOF
+    // once the parent closes its write end.
+    close(gate[1]);
+    close(ping[1]);
+    close(pong[0]);
+    while (read(ping[0], &c, 1) == 1) {
+      write(pong[1], &c, 1);
+    }
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  read_sched(&before);
+  uint64 start = nanotime();
+  for (int i = 0; i < trips; i++) {
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+  }
+  uint64 ns = nanotime() - start;
+  read_sched(&after);
+
+  close(ping[1]);
+  close(gate[1]);
+  for (int i = 0; i < nsleepers + 1; i++) {
+    wait(0);
+  }
+  close(pong[0]);
+
+  uint64 wakeups = after.wakeups - before.wakeups;
+  uint64 scans = after.wakescans - before.wakescans;
+  print_column(nsleepers, 8);
+  print_column(ns / trips, 10);
+  print_column(wakeups, 10);
+  uint64 per = wakeups ? scans * 100 / wakeups : 0;
+  printf("       %l.%l%l\n", per / 100, per / 10 % 10, per % 10);
+}
+
+int
+main(int argc, char **argv)
+{
+  int trips = 10000;
+
+  if (argc > 1) {
+    trips = atoi(argv[1]);
+  }
+  if (trips <= 0) {
+    sleepbench_error("invalid args");
+    exit(1);
+  }
+
+  printf(" sleepers    ns/trip    wakeups  examined/wakeup\n");
+  for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    run(counts[i], trips);
+  }
+  exit(0);
+}
@@ -0,0 +1,157 @@
+// Buffered input streams.
+//
+// A stream reads its file descriptor a block at a time into a
+// buffer and hands out bytes, characters and lines from there,
+// so reading a line costs one read() per block instead of one
+// per byte.
+//
+// fgets(), getline() and gets() take a bare file descriptor, so
+// they use an unbuffered stream on the stack: bytes they read
+// past the end of a line would be lost to the next read() of
+// that descriptor, or to a program exec'd with it. Code that
+// owns a descriptor, like boogsh reading a script, should open
+// a buffered stream with sopen() instead.
+
+#include "../kernel/types.h"
+#include "user.h"
+
+#define SBUFSIZE 1024
+
+struct stream {
+  int fd;
+  char *buf;
+  int size;      // capacity of buf
+  int pos;       // next byte to hand out
+  int n;         // bytes in buf
+  int err;       // a read() failed
+};
+
+// Start a buffered stream reading fd.
+struct stream*
+sopen(int fd)
+{
+  struct stream *s;
+
+  if((s = malloc(sizeof(*s) + SBUFSIZE)) == 0)
+    return 0;
+  s->fd = fd;
+  s->buf = (char*)(s + 1);
+  s->size = SBUFSIZE;
+  s->pos = s->n = 0;
+  s->err = 0;
+  return s;
+}
+
+// Close the stream and its file descriptor.
+void
+sclose(struct stream *s)
+{
+  close(s->fd);
+  free(s);
+}
+
+// Refill an empty buffer. Returns bytes read, 0 at end of file.
+static int
+sfill(struct stream *s)
+{
+  int n;
+
+  s->pos = s->n = 0;
+  if((n = read(s->fd, s->buf, s->size)) < 0){
+    s->err = 1;
+    return 0;
+  }
+  s->n = n;
+  return n;
+}
+
+// Next byte of the stream, or -1 at end of file or on error.
+int
+sgetc(struct stream *s)
+{
+  if(s->pos == s->n && sfill(s) == 0)
+    return -1;
+  return (uchar)s->buf[s->pos++];
+}
+
+// Read a line of at most max-1 bytes, including its newline
+// (or carriage return), into buf and terminate it.
+// Returns the number of bytes read, 0 at end of file.
+int
+sgets(char *buf, int max, struct stream *s)
+{
+  int i, c;
+
+  for(i = 0; i+1 < max; ){
+    if((c = sgetc(s)) < 0)
+      break;
+    buf[i++] = c;
+    if(c == '\n' || c == '\r')
+      break;
+  }
+  buf[i] = '\0';
+  return i;
+}
+
+// Read a whole line into *lineptr, which holds *n bytes and is
+// grown (or allocated, if null) as needed.
+// Returns the length of the line, 0 at end of file, -1 on error.
+int
+sgetline(char **lineptr, uint *n, struct stream *s)
+{
+  uint len = 0;
+  int c;
+
+  if(*lineptr == 0 && *n == 0){
+    *n = 128;
+    *lineptr = malloc(*n);
+  }
+
+  while((c = sgetc(s)) >= 0){
+    if(len + 1 >= *n){
+      char *bigger = malloc(*n * 2);
+      memcpy(bigger, *lineptr, len);
+      free(*lineptr);
+      *lineptr = bigger;
+      *n *= 2;
+    }
+    (*lineptr)[len++] = c;
+    if(c == '\n')
+      break;
+  }
+  (*lineptr)[len] = '\0';
+  if(len == 0 && s->err)
+    return -1;
+  return len;
+}
+
+// An unbuffered stream reading fd: one byte per read().
+#define UNBUFFERED(fd, c) { (fd), (c), 1, 0, 0, 0 }
+
+/* Lab 02 funcs fgets() (replacing gets()) and getline(). */
+
+/* fgets() returns number of bytes read and takes in an arbitrary file descriptor*/
+int
+fgets(char *buf, int max, int fd)
+{
+  char c;
+  struct stream s = UNBUFFERED(fd, &c);
+
+  return sgets(buf, max, &s);
+}
+
+int
+getline(char **lineptr, uint *n, int fd)
+{
+  char c;
+  struct stream s = UNBUFFERED(fd, &c);
+
+  return sgetline(lineptr, n, &s);
+}
+
+char*
+gets(char *buf, int max)
+{
+  fgets(buf, max, 0);
+  return buf;
+}
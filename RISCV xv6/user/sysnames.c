@@ -0,0 +1,52 @@
+#include "../kernel/types.h"
+#include "../kernel/syscall.h"
+#include "user.h"
+
+// System call names, for the tools that report on system
+// calls (benchmark, tracer).
+
+static char *names[] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_reboot]  "reboot",
+[SYS_shutdown] "shutdown",
+[SYS_unixtime] "unixtime",
+[SYS_strace]  "strace",
+[SYS_wait2]   "wait2",
+[SYS_benchmark_reset] "benchmark_reset",
+[SYS_getcwd]  "getcwd",
+[SYS_kstat]   "kstat",
+[SYS_sysstat] "sysstat",
+[SYS_tracedrain] "tracedrain",
+[SYS_prof]    "prof",
+[SYS_wait3]   "wait3",
+[SYS_monotime] "monotime",
+};
+
+char*
+sysname(int num)
+{
+  if (num <= 0 || num >= sizeof(names) / sizeof(names[0]) || names[num] == 0) {
+    return "?";
+  }
+  return names[num];
+}
@@ -1,10 +1,67 @@
 #include "user.h"
+#include "../kernel/syscall.h"
+#include "../kernel/trace.h"
+#include "../kernel/vdso.h"
+
+// Run a command with its system calls traced. The kernel
+// records each call in a ring buffer; this drains the buffer
+// while the command runs and prints one line per call.
+// usage: tracer command [args...]
+
+#define NRECS 32
+
+struct tracerec recs[NRECS];
+
+uint64 start_time;
 
 void tracer_error(char* err) 
 {
   printf("tracer error: %s\n", err);
 }
 
+// How many arguments of each system call to show.
+int nargs(int num)
+{
+  switch (num) {
+  case SYS_read: case SYS_write: case SYS_mknod:
+    return 3;
+  case SYS_exec: case SYS_open: case SYS_link: case SYS_fstat:
+  case SYS_wait2: case SYS_getcwd: case SYS_sysstat:
+    return 2;
+  case SYS_exit: case SYS_wait: case SYS_pipe: case SYS_kill:
+  case SYS_chdir: case SYS_dup: case SYS_sbrk: case SYS_sleep:
+  case SYS_unlink: case SYS_mkdir: case SYS_close:
+    return 1;
+  }
+  return 0;
+}
+
+// Print one trace record. Returns 1 if it is the exit of pid.
+int print_record(struct tracerec *r, int pid)
+{
+  if (r->num == TRACE_LOST) {
+    printf("[%d] ... %l records lost\n", r->pid, r->args[0]);
+    return 0;
+  }
+
+  // record times are time CSR readings; the time page has its rate.
+  uint64 us = vdsons((struct vdso*)VDSO, r->time - start_time) / 1000;
+  printf("[%d] %l us %s(", r->pid, us, sysname(r->num));
+  for (int i = 0; i < nargs(r->num); i++) {
+    if (i > 0) {
+      printf(", ");
+    }
+    if (i == 0 && r->str[0]) {
+      printf("\"%s\"", r->str);
+    } else {
+      printf("%d", (int)r->args[i]);
+    }
+  }
+  printf(") = %d\n", (int)r->ret);
+
+  return r->num == SYS_exit && r->pid == pid;
+}
+
 int main(int argc, char** argv)
 {
   if (argc < 2) {
@@ -12,20 +69,56 @@ int main(int argc, char** argv)
     exit(1);
   }
 
+  // the child reports over a pipe whether tracing started,
+  // so that we don't drain before there is anything to drain.
+  int fds[2];
+  char ok;
+  if (pipe(fds) < 0) {
+    tracer_error("pipe failed");
+    exit(1);
+  }
+
   int pid = fork();
 
   if (pid < 0) {
     tracer_error("fork failed");
     exit(1);
   } else if (pid == 0) {
-    strace();
+    ok = strace() == 0;
+    write(fds[1], &ok, 1);
+    close(fds[0]);
+    close(fds[1]);
+    if (!ok) {
+      exit(1);
+    }
     exec(argv[1], &argv[1]);
     tracer_error("exec failed");
     exit(1);
-  } else {
-    int status;
-    wait(&status);
   }
 
+  close(fds[1]);
+  if (read(fds[0], &ok, 1) != 1 || !ok) {
+    tracer_error("strace failed");
+    wait(0);
+    exit(1);
+  }
+  close(fds[0]);
+
+  // drain until the child's exit record shows up; the child
+  // stays a zombie, and its records readable, until we wait.
+  int done = 0, n;
+  while (!done && (n = tracedrain(pid, recs, NRECS)) >= 0) {
+    for (int i = 0; i < n && !done; i++) {
+      if (start_time == 0) {
+        start_time = recs[i].time;
+      }
+      done = print_record(&recs[i], pid);
+    }
+    if (n == 0) {
+      sleep(1);
+    }
+  }
+  wait(0);
+
   return 0;
 }
@@ -1,6 +1,7 @@
 #include "../kernel/types.h"
 #include "../kernel/stat.h"
 #include "../kernel/fcntl.h"
+#include "../kernel/vdso.h"
 #include "user.h"
 
 //
@@ -131,34 +132,6 @@ strchr(const char *s, char c)
   return 0;
 }
 
-char*
-gets(char *buf, int max)
-{
-  fgets(buf, max, 0);
-  return buf;
-}
-
-/* Lab 02 funcs fgets() (replacing gets()) and getline(). */
-
-/* fgets() returns number of bytes read and takes in an arbitrary file descriptor*/
-int
-fgets(char *buf, int max, int fd)
-{
-  int i, cc;
-  char c;
-
-  for(i=0; i+1 < max; ){
-    cc = read(fd, &c, 1);
-    if(cc < 1)
-      break;
-    buf[i++] = c;
-    if(c == '\n' || c == '\r')
-      break;
-  }
-  buf[i] = '\0';
-  return i;
-}
-
 int
 stat(const char *n, struct stat *st)
 {
@@ -224,41 +197,14 @@ memcpy(void *dst, const void *src, uint n)
   return memmove(dst, src, n);
 }
 
-int
-getline(char **lineptr, uint *n, int fd)
+// Nanoseconds since boot, like monotime() but without a system
+// call: the kernel lets user code read the time CSR and maps the
+// rate it runs at read-only at VDSO.
+uint64
+nanotime(void)
 {
-  if (*lineptr == 0 && *n == 0) {
-    *n = 128;
-    *lineptr = malloc(*n);
-  }
-
-  char *buf = *lineptr;
-  uint total_read = 0;
-  while (1) {
-    int read_sz = fgets(buf + total_read, *n - total_read, fd);
-    if (read_sz == 0) {
-      return total_read;
-    } else if (read_sz == -1) {
-      // error
-      return -1;
-    }
-
-    total_read += read_sz;
-    if (buf[total_read - 1] == '\n') {
-      break;
-    }
+  uint64 t;
 
-    uint new_n = *n * 2;
-    char *new_buf = malloc(new_n);
-    memcpy(new_buf, buf, *n);
-    free(buf);
-
-    buf = new_buf;
-
-    *n = new_n;
-    *lineptr = buf;
-  }
-
-  return total_read;
+  asm volatile("rdtime %0" : "=r" (t));
+  return vdsons((struct vdso*)VDSO, t);
 }
-
@@ -15,6 +15,11 @@
 struct command;
 
 struct stat;
+struct sysstat;
+struct tracerec;
+struct profsample;
+struct rusage;
+struct stream;
 
 // system calls
 int fork(void);
@@ -45,6 +50,12 @@ uint64 unixtime(void);
 int strace(void);
 int benchmark_reset(void);
 int getcwd(char *, int);
+int kstat(int, void*, int);
+int sysstat(int, struct sysstat*);
+int tracedrain(int, struct tracerec*, int);
+int prof(int, struct profsample*, int);
+int wait3(int*, int, struct rusage*);
+uint64 monotime(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -54,9 +65,6 @@ char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...);
 void printf(const char*, ...);
-char* gets(char*, int max);
-int fgets(char*, int max, int fd);
-int getline(char**, uint*, int);
 uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
@@ -70,3 +78,21 @@ void *memcpy(void *, const void *, uint);
 uint strspn(const char *str, const char *chars);
 uint strcspn(const char *str, const char *chars);
 char* next_token(char **str_ptr, const char *delim);
+uint64 nanotime(void);
+
+// sysnames.c
+char* sysname(int);
+
+// report.c
+void print_column(uint64, int);
+uint64 percentile(uint*, uint64, int);
+
+// stream.c
+struct stream* sopen(int);
+void sclose(struct stream*);
+int sgetc(struct stream*);
+int sgets(char*, int max, struct stream*);
+int sgetline(char**, uint*, struct stream*);
+char* gets(char*, int max);
+int fgets(char*, int max, int fd);
+int getline(char**, uint*, int);
@@ -43,3 +43,9 @@ entry("strace");
 entry("wait2");
 entry("benchmark_reset");
 entry("getcwd");
+entry("kstat");
+entry("sysstat");
+entry("tracedrain");
+entry("prof");
+entry("wait3");
+entry("monotime");